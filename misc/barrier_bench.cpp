@@ -0,0 +1,123 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Standalone stress test and benchmark for the phase barrier (src/barrier.h).
+ *
+ * Runs threads that join, sync every phase, and optionally leave and rejoin
+ * the barrier, like simulator threads around blocking syscalls. It reports
+ * the wall time per phase, so flat (fanout 0) and tree wakeups can be
+ * compared on the same host. A hang means a lost wakeup.
+ *
+ * Build (from the repo root):
+ *   g++ -O2 -std=c++11 -DMT_SAFE_LOG -Isrc misc/barrier_bench.cpp src/log.cpp -o barrier_bench -lpthread
+ * Run:
+ *   ./barrier_bench <threads> <parallelThreads> <fanout> <phases> <leave%>
+ * e.g., compare "./barrier_bench 64 64 0 20000 5" with "./barrier_bench 64 64 4 20000 5".
+ * Results are only meaningful with at least parallelThreads host cores.
+ */
+
+#include <chrono>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "barrier.h"
+
+// barrier.h allocates from the global heap; plain malloc is enough here
+void* gm_malloc(size_t sz) { return malloc(sz); }
+void* __gm_calloc(size_t num, size_t sz) { return calloc(num, sz); }
+void gm_free(void* ptr) { free(ptr); }
+char* gm_strdup(const char* str) { return strdup(str); }
+
+class PhaseCounter : public Callee {
+    public:
+        volatile uint64_t phases;
+        PhaseCounter() : phases(0) {}
+        void callback() { phases++; }
+};
+
+static lock_t schedLock;
+static Barrier* bar;
+static PhaseCounter counter;
+static uint64_t maxPhases;
+static uint32_t leavePct;
+
+static void spin(uint32_t iters) {
+    for (volatile uint32_t i = 0; i < iters; i++) {}
+}
+
+static void* worker(void* arg) {
+    uint32_t tid = (uintptr_t)arg;
+    unsigned seed = tid*7919 + 1;
+    futex_lock(&schedLock);
+    bar->join(tid, &schedLock);
+    while (counter.phases < maxPhases) {
+        if (leavePct && (uint32_t)(rand_r(&seed) % 100) < leavePct) {
+            // Leave for a bit, as in a blocking syscall
+            futex_lock(&schedLock);
+            bar->leave(tid);
+            futex_unlock(&schedLock);
+            spin(2000);
+            futex_lock(&schedLock);
+            bar->join(tid, &schedLock);
+        }
+        spin(500);  // bound-phase work
+        futex_lock(&schedLock);
+        bar->sync(tid, &schedLock);
+    }
+    futex_lock(&schedLock);
+    bar->leave(tid);
+    futex_unlock(&schedLock);
+    return nullptr;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc != 6) {
+        fprintf(stderr, "Usage: %s <threads> <parallelThreads> <fanout> <phases> <leave%%>\n", argv[0]);
+        return 1;
+    }
+    uint32_t threads = atoi(argv[1]);
+    uint32_t parallelThreads = atoi(argv[2]);
+    uint32_t fanout = atoi(argv[3]);
+    maxPhases = atol(argv[4]);
+    leavePct = atoi(argv[5]);
+    if (!threads || threads > MAX_THREADS || !parallelThreads || fanout > MAX_WAKE_FANOUT) {
+        fprintf(stderr, "Need 0 < threads <= %d, parallelThreads > 0, fanout <= %d\n", MAX_THREADS, MAX_WAKE_FANOUT);
+        return 1;
+    }
+
+    futex_init(&schedLock);
+    bar = new Barrier(parallelThreads, &counter, fanout);
+    std::vector<pthread_t> ths(threads);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < threads; i++) pthread_create(&ths[i], nullptr, worker, (void*)(uintptr_t)i);
+    for (pthread_t& th : ths) pthread_join(th, nullptr);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("threads %d parallel %d fanout %d leave %d%%: %ld phases, %.1f us/phase\n",
+            threads, parallelThreads, fanout, leavePct, counter.phases, secs*1e6/counter.phases);
+    return 0;
+}
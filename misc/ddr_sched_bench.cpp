@@ -0,0 +1,213 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Standalone benchmark and stress test for the DDRMemory request scheduler
+ * (DDRMemory::trySchedule() in src/ddr_mem.cpp).
+ *
+ * Feeds random request streams straight into the scheduler of one channel
+ * across 48 configurations: 1-4 ranks, 8/16 banks, queue depths 16 and 256,
+ * open/closed page, rowHitLimit 0/4/unlimited, deferred writes, row and
+ * write drain policies, power down, bank XOR hashing, and refreshes. It
+ * reports the scheduling decisions made and the average host cycles per
+ * trySchedule() call, so scheduler changes can be compared on the same host.
+ * Build with -DDDR_VALIDATE_SCHED=1 to also check every decision against a
+ * linear FR-FCFS scan of the queue.
+ *
+ * Build (from src/, with libconfig built in ext_lib/libconfig):
+ *   g++ -O2 -std=c++11 -DMT_SAFE_LOG -I. -I../ext_lib/libconfig/include ../misc/ddr_sched_bench.cpp \
+ *       galloc.cpp log.cpp config.cpp -L../ext_lib/libconfig/lib -lconfig++ -o ddr_sched_bench
+ * Run:
+ *   ./ddr_sched_bench <uniform|skew|stream> [bulk]
+ * "skew" sends half the requests to one bank, which builds long bank queues;
+ * "stream" walks rows sequentially; "bulk" adds multi-line transfers.
+ */
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// The scheduler and its queues are private; drive them directly
+#define private public
+#include "ddr_mem.cpp"
+#undef private
+
+GlobSimInfo* zinfo;
+
+// Events the scheduler responds to are never simulated here
+void ContentionSim::enqueueSynced(TimingEvent*, uint64_t) {}
+void ContentionSim::placeOnDomainNode(const void*, size_t, uint32_t) {}
+void TimingEvent::checkDomain(TimingEvent*) {}
+void TimingEvent::parentDone(uint64_t) {}
+void TimingEvent::requeue(uint64_t) {}
+
+/* Access events are normally slab-allocated and freed on done(), so carve
+ * fixed slots out of never-reclaimed slabs and reuse the done ones.
+ */
+static const uint32_t SLOTS = 1 << 16;
+static const uint32_t SLOT_SIZE = 128;
+static char* slots[SLOTS];
+static uint32_t slotIdx = 0;
+
+static void initSlots() {
+    slab::Slab* sl = nullptr;
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < SLOTS; i++) {
+        if (!sl || used + SLOT_SIZE > sizeof(sl->buf)) {
+            sl = (slab::Slab*)aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+            sl->liveElems = 1u << 30;
+            sl->usedBytes = -1u;
+            used = 0;
+        }
+        slots[i] = sl->buf + used;
+        used += SLOT_SIZE;
+        ((TimingEvent*)slots[i])->state = EV_DONE;
+    }
+}
+
+static DDRMemoryAccEvent* newAccEvent(DDRMemory* m, bool write, Address addr, uint32_t bursts) {
+    static_assert(sizeof(DDRMemoryAccEvent) <= SLOT_SIZE, "slots too small");
+    char* s;
+    do {
+        s = slots[slotIdx++ % SLOTS];
+    } while (((TimingEvent*)s)->state != EV_DONE);
+    DDRMemoryAccEvent* ev = ::new (s) DDRMemoryAccEvent(m, write, addr, bursts, 0, 0, 0);
+    ev->state = EV_HELD;
+    return ev;
+}
+
+enum Traffic {UNIFORM, SKEW, STREAM};
+
+static inline uint64_t rdtsc() { return __builtin_ia32_rdtsc(); }
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <uniform|skew|stream> [bulk]\n", argv[0]);
+        return 1;
+    }
+    Traffic traffic = !strcmp(argv[1], "skew")? SKEW : !strcmp(argv[1], "stream")? STREAM : UNIFORM;
+    bool bulk = argc > 2 && !strcmp(argv[2], "bulk");
+
+    InitLog("", nullptr);
+    gm_init(1 << 28);
+    zinfo = gm_calloc<GlobSimInfo>();
+    initSlots();
+
+    uint64_t scheds = 0, schedTsc = 0;
+    for (uint32_t cfg = 0; cfg < 48; cfg++) {
+        std::mt19937_64 rng(cfg);
+        g_string name("mem");
+        uint32_t ranks = 1 << (cfg % 3);
+        uint32_t banksPerRank = (cfg & 4)? 16 : 8;
+        uint32_t rowHitLimit = ((cfg/8) % 3 == 0)? 0 : ((cfg/8) % 3 == 1)? 4 : -1u;
+        bool closedPage = cfg & 8;
+        bool deferWrites = cfg & 16;
+        uint32_t depth = (cfg & 32)? 256 : 16;
+        DDRMemory* m = new DDRMemory(64, 8192, ranks, banksPerRank, 4000, "DDR3-1333-CL10", "rank:col:bank", 10,
+                depth, rowHitLimit, deferWrites, closedPage, 0, name);
+        AggregateStat* stats = new AggregateStat();
+        stats->init("mem", "Memory stats");
+        m->initStats(stats);
+        m->setRowPolicy((DDRMemory::RowPolicy)(cfg % 4), (cfg & 16)? 7 : 40);
+        m->setPowerDown((cfg & 1)? 20 : 0);
+        m->setWritePolicy(depth - 2, 1, true, depth/2, 64);
+        m->setBankXorHash(cfg & 4);
+        if (bulk) m->setBulkPolicy((cfg & 2)? 64 : 16, (cfg & 1)? 4 : 1, !(cfg & 1) || (cfg & 8));
+
+        uint64_t cycle = 100;
+        uint64_t next = -1ul;
+        uint32_t rowRange = 1 + rng() % 64;
+        Address streamAddr = 0;
+        uint32_t streamLeft = 0;
+        for (uint32_t i = 0; i < 200000; i++) {
+            uint32_t action = rng() % 10;
+            if (bulk && action == 8 && rng() % 8 == 0) {
+                bool write = rng() % 2;
+                Address addr = ((rng() % rowRange) << 20) | (rng() & 0xfffff);
+                if (rng() % 2) addr &= ~63ul;
+                uint32_t bursts = (rng() % 3 == 0)? 4096 : 256;
+                DDRMemoryAccEvent* ev = newAccEvent(m, write, addr, bursts);
+                if (write) m->wrBufferedBursts += bursts;
+                m->startBulk(ev, cycle, m->memToSysCycle(cycle));
+                next = std::min(next, m->feedBulkChunks(cycle));
+            } else if (action < 5 && !m->rdQueue.full() && !m->wrQueue.full()) {
+                bool write = rng() % 3 == 0;
+                Address addr;
+                if (traffic == STREAM) {
+                    if (!streamLeft) {
+                        streamAddr = ((rng() % rowRange) << 20) | (rng() & 0xfffff);
+                        streamLeft = 1 + rng() % 32;
+                    }
+                    addr = streamAddr + (32 - streamLeft)*banksPerRank*ranks;
+                    streamLeft--;
+                } else {
+                    addr = ((rng() % rowRange) << 20) | (rng() & 0xfffff);
+                    if (traffic == SKEW && rng() % 2) addr &= ~(Address)(banksPerRank - 1);  // hot bank
+                }
+                DDRMemory::Request* req = (deferWrites && write)? m->wrQueue.alloc() : m->rdQueue.alloc();
+                req->addr = addr;
+                req->loc = m->mapLineAddr(addr);
+                req->data_size = 4;
+                req->write = write;
+                req->arrivalCycle = cycle;
+                req->startSysCycle = m->memToSysCycle(cycle);
+                req->ev = newAccEvent(m, write, addr, 4);
+                req->bulk = nullptr;
+                req->accClass = 0;
+                if (write) m->wrBufferedBursts += 4;
+                m->queue(req, cycle);
+                next = std::min(next, cycle);
+            } else if (action == 9 && rng() % 50 == 0) {
+                m->refresh(m->memToSysCycle(cycle));
+            } else if (next != -1ul) {
+                cycle = std::max(cycle, next);
+                uint64_t start = rdtsc();
+                next = m->trySchedule(cycle, m->matchingMemToSysCycle(cycle));
+                schedTsc += rdtsc() - start;
+                scheds++;
+                if (bulk) next = std::min(next, m->feedBulkChunks(cycle));
+            }
+            cycle += rng() % 4;
+        }
+
+        // Drain everything, so each run also checks that no request is lost
+        while (next != -1ul) {
+            cycle = std::max(cycle, next);
+            next = m->trySchedule(cycle, m->matchingMemToSysCycle(cycle));
+            if (bulk) next = std::min(next, m->feedBulkChunks(cycle));
+            cycle++;
+        }
+        assert_msg(m->rdQueue.empty() && m->wrQueue.empty() && m->bulkTransfers.empty() && !m->wrBufferedBursts,
+                "cfg %d: requests left after draining", cfg);
+        printf("cfg %2d: %lu reads %lu writes, %lu row hits\n", cfg, m->profReads.get(), m->profWrites.get(),
+                m->profReadHits.get() + m->profWriteHits.get());
+    }
+    printf("%lu scheduling decisions, %.1f cycles/decision\n", scheds, (double)schedTsc/scheds);
+    return 0;
+}
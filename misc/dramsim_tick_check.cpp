@@ -0,0 +1,246 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks that DRAMSimMemory, driven by its tick event and enqueue() as in
+ * the weave phase, gives the same results as stepping DRAMSim2 one cycle at
+ * a time (src/dramsim_mem_ctrl.cpp).
+ *
+ * Replays a recorded DRAMSim2 trace in k6 format ("0xADDR TYPE CYCLE", e.g.
+ * traces/k6_aoe_02_short.trc in DRAMSim2) twice, each time on a fresh
+ * DRAMSim2 instance:
+ *  - Through DRAMSimMemory, with a PrioQueue stepped as one ContentionSim
+ *    domain. Requests are queued at the start of their phase.
+ *  - With a plain loop that calls update() every cycle, and adds each
+ *    request on its cycle in the order the domain queue runs it: before that
+ *    cycle's update() on the first cycle of a phase, after it otherwise.
+ * Then it compares the completion cycle of every request and the latency
+ * stats. Long idle gaps in the trace check that nothing is skipped or
+ * reordered while no request is in flight.
+ *
+ * Build (from src/, with DRAMSIMPATH pointing to a DRAMSim2 build; add
+ * -D_GLIBCXX_USE_CXX11_ABI=0 if libdramsim was built with the old string ABI):
+ *   g++ -O2 -std=c++11 -D_WITH_DRAMSIM_=1 -DMT_SAFE_LOG -I. -I$DRAMSIMPATH -I../ext_lib/libconfig/include \
+ *       ../misc/dramsim_tick_check.cpp galloc.cpp log.cpp -L$DRAMSIMPATH -ldramsim -Wl,-rpath,$DRAMSIMPATH \
+ *       -o dramsim_tick_check
+ * Run:
+ *   ./dramsim_tick_check <trace> <deviceIni> <systemIni> <outputDir> [cpuMHz] [phaseLength]
+ * Exits with 1 if any request completes on a different cycle.
+ */
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// The stats and the event hold/release state are private; read them directly
+#define private public
+#include "dramsim_mem_ctrl.cpp"
+#undef private
+
+GlobSimInfo* zinfo;
+uint32_t lineBits = 6;
+
+// The one domain queue; the tick event and requests go through it
+static PrioQueue<TimingEvent, PQ_BLOCKS>* pq;
+
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) { pq->enqueue(ev, cycle); }
+void TimingEvent::requeue(uint64_t cycle) {
+    assert(state == EV_RUNNING || state == EV_HELD);
+    state = EV_QUEUED;
+    pq->enqueue(this, cycle);
+}
+void TimingEvent::checkDomain(TimingEvent*) {}
+void TimingEvent::parentDone(uint64_t) {}
+
+// Child of each access event, records when its parent is done
+class DoneEvent : public TimingEvent {
+    public:
+        uint64_t doneCycle;
+        DoneEvent() : TimingEvent(0, 0, 0), doneCycle(-1ul) {}
+        void parentDone(uint64_t cycle) { doneCycle = cycle; }
+        void simulate(uint64_t) { panic("DoneEvent is never queued"); }
+};
+
+/* Access events are normally slab-allocated and freed on done(), so carve
+ * them out of never-reclaimed slabs
+ */
+static char* newEventSlot(size_t sz) {
+    static slab::Slab* sl = nullptr;
+    static uint32_t used = 0;
+    sz = (sz + 63) & ~63ul;
+    if (!sl || used + sz > sizeof(sl->buf)) {
+        sl = (slab::Slab*)aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        sl->liveElems = 1u << 30;
+        sl->usedBytes = -1u;
+        used = 0;
+    }
+    char* res = sl->buf + used;
+    used += sz;
+    return res;
+}
+
+struct TraceReq {
+    uint64_t cycle;
+    uint64_t addr;
+    bool write;
+};
+
+static std::vector<TraceReq> readTrace(const char* file) {
+    std::ifstream in(file);
+    if (!in) panic("Cannot open trace %s", file);
+    std::vector<TraceReq> trace;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string addr, type;
+        uint64_t cycle;
+        if (!(ss >> addr >> type >> cycle)) continue;
+        bool write;
+        if (type == "P_MEM_WR" || type == "BOFF") write = true;
+        else if (type == "P_MEM_RD" || type == "P_FETCH" || type == "P_LOCK_RD" || type == "P_LOCK_WR") write = false;
+        else panic("Unknown request type %s in trace %s", type.c_str(), file);
+        if (!trace.empty() && cycle < trace.back().cycle) panic("Trace %s is not sorted by cycle", file);
+        trace.push_back({cycle, strtoul(addr.c_str(), nullptr, 16), write});
+    }
+    return trace;
+}
+
+// Per-cycle reference: DRAMSim completes same-address requests in order
+class ReferenceSim {
+    private:
+        std::multimap<uint64_t, uint32_t> inflight;  // addr -> request index
+        std::vector<uint64_t>& doneCycles;
+        uint64_t curCycle;
+
+    public:
+        explicit ReferenceSim(std::vector<uint64_t>& _doneCycles) : doneCycles(_doneCycles), curCycle(0) {}
+
+        void run(MultiChannelMemorySystem* dram, const std::vector<TraceReq>& trace, uint64_t phaseLength) {
+            TransactionCompleteCB* cb = new Callback<ReferenceSim, void, unsigned, uint64_t, uint64_t>(this, &ReferenceSim::returnCb);
+            dram->RegisterCallbacks(cb, cb, nullptr);
+            uint32_t next = 0;
+            while (next < trace.size() || !inflight.empty()) {
+                // Requests on this cycle, last queued first
+                uint32_t end = next;
+                while (end < trace.size() && trace[end].cycle == curCycle) end++;
+                bool addFirst = curCycle % phaseLength == 0;
+                if (!addFirst) dram->update();
+                for (uint32_t i = end; i > next; i--) {
+                    dram->addTransaction(trace[i-1].write, trace[i-1].addr);
+                    inflight.insert(std::make_pair(trace[i-1].addr, i-1));
+                }
+                next = end;
+                if (addFirst) dram->update();
+                curCycle++;
+            }
+        }
+
+        void returnCb(unsigned, uint64_t addr, uint64_t) {
+            auto it = inflight.find(addr);
+            assert((it != inflight.end()));
+            doneCycles[it->second] = curCycle + 1;
+            inflight.erase(it);
+        }
+};
+
+int main(int argc, const char* argv[]) {
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s <trace> <deviceIni> <systemIni> <outputDir> [cpuMHz] [phaseLength]\n", argv[0]);
+        return 1;
+    }
+    std::string deviceIni = argv[2], systemIni = argv[3], outputDir = argv[4];
+    uint64_t cpuMHz = (argc > 5)? strtoul(argv[5], nullptr, 10) : 2000;
+    uint64_t phaseLength = (argc > 6)? strtoul(argv[6], nullptr, 10) : 1000;
+
+    InitLog("", nullptr);
+    gm_init(1 << 28);
+    zinfo = gm_calloc<GlobSimInfo>();
+    pq = new PrioQueue<TimingEvent, PQ_BLOCKS>();
+
+    std::vector<TraceReq> trace = readTrace(argv[1]);
+    if (trace.empty()) panic("Empty trace %s", argv[1]);
+
+    // Event-driven, as in the weave phase
+    std::string traceName = "tick";
+    g_string name("dramsim");
+    DRAMSimMemory* mem = new DRAMSimMemory(deviceIni, systemIni, outputDir, traceName, 16384, cpuMHz*1000000, 0, 0, name);
+    AggregateStat* stats = new AggregateStat();
+    stats->init("mem", "Memory stats");
+    mem->initStats(stats);
+
+    DoneEvent* dones = (DoneEvent*)calloc(trace.size(), sizeof(DoneEvent));
+    uint32_t next = 0;
+    for (uint64_t phaseStart = 0; next < trace.size() || mem->inflightRequests.size(); phaseStart += phaseLength) {
+        uint64_t limit = phaseStart + phaseLength;
+        // Bound phase: this phase's requests
+        for (; next < trace.size() && trace[next].cycle < limit; next++) {
+            DRAMSimAccEvent* ev = ::new (newEventSlot(sizeof(DRAMSimAccEvent))) DRAMSimAccEvent(mem, trace[next].write, trace[next].addr, 0);
+            ::new (&dones[next]) DoneEvent();
+            ev->addChild(&dones[next], (EventRecorder*)nullptr);
+            ev->state = EV_QUEUED;
+            pq->enqueue(ev, trace[next].cycle);
+        }
+        // Weave phase
+        while (pq->size() && pq->firstCycle() < limit) {
+            uint64_t cycle;
+            TimingEvent* ev = pq->dequeue(cycle);
+            ev->run(cycle);
+        }
+    }
+
+    // Per-cycle reference, on a fresh instance
+    std::vector<uint64_t> refDone(trace.size(), -1ul);
+    traceName = "ref";
+    MultiChannelMemorySystem* refDram = getMemorySystemInstance(deviceIni, systemIni, outputDir, traceName, 16384);
+    refDram->setCPUClockSpeed(cpuMHz*1000000);
+    ReferenceSim ref(refDone);
+    ref.run(refDram, trace, phaseLength);
+
+    uint64_t mismatches = 0, refRdLat = 0, refWrLat = 0, reads = 0;
+    for (uint32_t i = 0; i < trace.size(); i++) {
+        uint64_t lat = refDone[i] - trace[i].cycle;
+        if (trace[i].write) refWrLat += lat;
+        else refRdLat += lat, reads++;
+        if (dones[i].doneCycle != refDone[i]) {
+            if (mismatches < 10) {
+                info("Request %d (%s %lx at %ld) done at %ld, per-cycle stepping says %ld", i, trace[i].write? "wr" : "rd",
+                        trace[i].addr, trace[i].cycle, dones[i].doneCycle, refDone[i]);
+            }
+            mismatches++;
+        }
+    }
+    if (mem->profTotalRdLat.get() != refRdLat || mem->profTotalWrLat.get() != refWrLat) {
+        info("Latency stats differ: rd %ld vs %ld, wr %ld vs %ld", mem->profTotalRdLat.get(), refRdLat,
+                mem->profTotalWrLat.get(), refWrLat);
+        mismatches++;
+    }
+    printf("%ld requests (%ld rd), %ld cycles, avg latency %.1f rd / %.1f wr cycles, %ld mismatches\n",
+            trace.size(), reads, mem->curCycle, reads? 1.0*refRdLat/reads : 0.0,
+            (trace.size() > reads)? 1.0*refWrLat/(trace.size() - reads) : 0.0, mismatches);
+    return mismatches? 1 : 0;
+}
@@ -31,6 +31,14 @@
  *
  * PARALLELISM CONTROL: The barrier limits the number of threads that run at the same time.
  *
+ * WAKEUPS: By default, the thread that wakes up a group of threads (e.g., at the
+ * start of a phase) issues one futex wake per thread, serially and with the
+ * scheduler lock held. With a non-zero wake fanout, it only wakes the first
+ * fanout threads of the group; every woken thread then wakes the next fanout
+ * threads in turn, so a group of N threads is woken in parallel, in
+ * O(log N) steps. All state changes still happen under the scheduler lock;
+ * only the futex wake syscalls move out of it.
+ *
  * Author: Daniel Sanchez <sanchezd@stanford.edu>
  * Date: Apr 2011
  */
@@ -50,6 +58,8 @@
 #include "log.h"
 #include "mtrand.h"
 
+#define MAX_WAKE_FANOUT 8
+
 // Configure futex timeouts (die rather than deadlock)
 #define TIMEOUT_LENGTH 20 //seconds
 #define MAX_TIMEOUTS 10
@@ -73,11 +83,15 @@ class Barrier : public GlobAlloc {
             volatile State state;
             volatile uint32_t futexWord;
             uint32_t lastIdx;
-            uint32_t pad;
+            uint32_t numWakeChildren; //threads this one must wake once woken (tree wakeups)
+            uint32_t wakeChildren[MAX_WAKE_FANOUT];
         };
 
         ThreadSyncInfo threadList[MAX_THREADS];
 
+        uint32_t wakeFanout; //0 for flat wakeups
+        uint32_t* wakeBatch; //threads woken by the current checkRunList() call (tree wakeups)
+
         uint32_t* runList;
         uint32_t runListSize;
         uint32_t curThreadIdx;
@@ -102,12 +116,17 @@ class Barrier : public GlobAlloc {
         Callee* sched; //FIXME: I don't like this organization, but don't have time to refactor the barrier code, this is used for a callback when the phase is done
 
     public:
-        Barrier(uint32_t _parallelThreads, Callee* _sched) : parallelThreads(_parallelThreads), rnd(0xBA77137), sched(_sched) {
+        Barrier(uint32_t _parallelThreads, Callee* _sched, uint32_t _wakeFanout = 0) : parallelThreads(_parallelThreads), rnd(0xBA77137), sched(_sched) {
             for (uint32_t t = 0; t < MAX_THREADS; t++) {
                 threadList[t].state = OFFLINE;
                 threadList[t].futexWord = 0;
+                threadList[t].numWakeChildren = 0;
             }
 
+            wakeFanout = _wakeFanout;
+            if (wakeFanout > MAX_WAKE_FANOUT) panic("Barrier wake fanout %d exceeds the maximum (%d)", wakeFanout, MAX_WAKE_FANOUT);
+            wakeBatch = gm_calloc<uint32_t>(MAX_THREADS);
+
             runList = gm_calloc<uint32_t>(MAX_THREADS);
             runListSize = 0;
             curThreadIdx = 0;
@@ -153,13 +172,9 @@ class Barrier : public GlobAlloc {
 
             if (threadList[tid].state == WAITING) {
                 DEBUG_BARRIER("[%d] Waiting on join", tid);
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
+                waitForWakeup(tid);
             }
+            wakeChildren(tid);
         }
 
         //Must be called with schedLock held
@@ -188,16 +203,33 @@ class Barrier : public GlobAlloc {
             futex_unlock(schedLock);
 
             if (threadList[tid].state == WAITING) {
-                while (true) {
-                    int futex_res = syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
-                    if (futex_res == 0 || threadList[tid].futexWord != 1) break;
-                }
-                //The thread that wakes us up changes this
-                assert(threadList[tid].state == RUNNING);
+                waitForWakeup(tid);
             }
+            wakeChildren(tid);
         }
 
     private:
+        void waitForWakeup(uint32_t tid) {
+            while (true) {
+                syscall(SYS_futex, &threadList[tid].futexWord, FUTEX_WAIT, 1 /*a racing thread waking us up will change value to 0, and we won't block*/, nullptr, nullptr, 0);
+                //With tree wakeups, a wake meant for an earlier wait may arrive late, so only trust futexWord
+                if (threadList[tid].futexWord != 1) break;
+            }
+            //The thread that wakes us up changes this
+            assert(threadList[tid].state == RUNNING);
+        }
+
+        //Tree wakeups: wake the threads our waker left to us. Set before our
+        //futexWord was cleared, and not changed until we wait again.
+        void wakeChildren(uint32_t tid) {
+            uint32_t n = threadList[tid].numWakeChildren;
+            threadList[tid].numWakeChildren = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t ctid = threadList[tid].wakeChildren[i];
+                syscall(SYS_futex, &threadList[ctid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+            }
+        }
+
         inline void checkEndPhase(uint32_t tid) {
             if (curThreadIdx == runListSize && runningThreads == 0) {
                 if (leftThreads == runListSize) {
@@ -254,22 +286,45 @@ class Barrier : public GlobAlloc {
         }
 
         inline void checkRunList(uint32_t tid) {
+            uint32_t batchSize = 0;
             while (runningThreads < parallelThreads && curThreadIdx < runListSize) {
                 //Wake next thread
                 uint32_t idx = curThreadIdx++;
                 uint32_t wtid = runList[idx];
                 if (threadList[wtid].state == WAITING) {
                     DEBUG_BARRIER("[%d] Waking %d runningThreads %d", tid, wtid, runningThreads);
-                    threadList[wtid].state = RUNNING; //must be set before writing to futexWord to avoid wakeup race
+                    if (wakeFanout) {
+                        //Thread i of the batch wakes threads (i+1)*fanout ... (i+2)*fanout-1; we wake the first fanout
+                        uint32_t pos = batchSize++;
+                        wakeBatch[pos] = wtid;
+                        threadList[wtid].numWakeChildren = 0;
+                        if (pos >= wakeFanout) {
+                            ThreadSyncInfo& parent = threadList[wakeBatch[pos/wakeFanout - 1]];
+                            parent.wakeChildren[parent.numWakeChildren++] = wtid;
+                        }
+                    }
                     threadList[wtid].lastIdx = idx;
+                    runningThreads++;
+                    if (wakeFanout) continue; //woken once the batch's wake tree is complete
+                    threadList[wtid].state = RUNNING; //must be set before writing to futexWord to avoid wakeup race
                     bool succ = __sync_bool_compare_and_swap(&threadList[wtid].futexWord, 1, 0);
                     if (!succ) panic("Wakeup race in barrier?");
                     syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
-                    runningThreads++;
                 } else {
                     DEBUG_BARRIER("[%d] Skipping %d state %d", tid, wtid, threadList[wtid].state);
                 }
             }
+
+            //Tree wakeups: each thread's children are set, so threads can now run and wake them.
+            //Go backwards, so that a thread can only run once all its children are runnable too
+            //(otherwise, it could wake a child before its futexWord changes, and the child would wait again)
+            for (uint32_t i = batchSize; i-- > 0;) {
+                uint32_t wtid = wakeBatch[i];
+                threadList[wtid].state = RUNNING;
+                bool succ = __sync_bool_compare_and_swap(&threadList[wtid].futexWord, 1, 0);
+                if (!succ) panic("Wakeup race in barrier?");
+                if (i < wakeFanout) syscall(SYS_futex, &threadList[wtid].futexWord, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+            }
         }
 
         void tryWakeNext(uint32_t tid) {
@@ -31,9 +31,9 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <vector>
+#include "core.h"
+#include "host_placement.h"
 #include "log.h"
-#include "ooo_core.h"
-#include "timing_core.h"
 #include "timing_event.h"
 #include "zsim.h"
 
@@ -45,12 +45,6 @@ bool ContentionSim::CompareEvents::operator()(TimingEvent* lhs, TimingEvent* rhs
     return lhs->cycle > rhs->cycle;
 }
 
-bool ContentionSim::CompareDomains::operator()(DomainData* d1, DomainData* d2) const {
-    uint64_t v1 = d1->queuePrio;
-    uint64_t v2 = d2->queuePrio;
-    return (v1 > v2);
-}
-
 
 void ContentionSim::SimThreadTrampoline(void* arg) {
     ContentionSim* csim = static_cast<ContentionSim*>(arg);
@@ -65,23 +59,34 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     limit = 0;
     lastLimit = 0;
     inCSim = false;
+    lastPhaseCrossings = 0;
+    lastPhaseSkew = 0;
 
-    domains = gm_calloc<DomainData>(numDomains);
+    //Page-aligned, so each thread's home domains can be placed on its host node
+    domains = gm_memalign<DomainData>(HOST_PAGE_ALIGN, numDomains);
+    memset(static_cast<void*>(domains), 0, numDomains*sizeof(DomainData));
     simThreads = gm_calloc<SimThreadData>(numSimThreads);
 
     for (uint32_t i = 0; i < numDomains; i++) {
         new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
         domains[i].curCycle = 0;
-        futex_init(&domains[i].pqLock);
+        domains[i].inbox = nullptr;
+        domains[i].phaseCrossings = 0;
+        domains[i].busy = 0;
+        domains[i].done = true;
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
-
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
         futex_lock(&simThreads[i].wakeLock); //starts locked, so first actual call to lock blocks
         simThreads[i].firstDomain = i*numDomains/numSimThreads;
         simThreads[i].supDomain = (i+1)*numDomains/numSimThreads;
+        simThreads[i].phaseSkew = 0;
+
+        uint32_t homeDomains = simThreads[i].supDomain - simThreads[i].firstDomain;
+        for (uint32_t d = simThreads[i].firstDomain; d < simThreads[i].supDomain; d++) domains[d].runAtLimit = homeDomains > 1;
+        zinfo->hostPlacement->bindToNode(&domains[simThreads[i].firstDomain], homeDomains*sizeof(DomainData),
+                zinfo->hostPlacement->getSimThreadNode(i));
     }
 
     futex_init(&waitLock);
@@ -100,20 +105,15 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
 }
 
+void ContentionSim::placeOnDomainNode(const void* ptr, size_t bytes, uint32_t domain) {
+    assert(domain < numDomains);
+    uint32_t thid = 0;
+    while (simThreads[thid].supDomain <= domain) thid++;
+    zinfo->hostPlacement->bindToNode(ptr, bytes, zinfo->hostPlacement->getSimThreadNode(thid));
+}
+
 void ContentionSim::postInit() {
-    for (uint32_t i = 0; i < zinfo->numCores; i++) {
-        TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
-        if (tcore) {
-            skipContention = false;
-            return;
-        }
-        OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
-        if (ocore) {
-            skipContention = false;
-            return;
-        }
-    }
-    skipContention = true;
+    skipContention = phaseCores.empty();
 }
 
 void ContentionSim::initStats(AggregateStat* parentStat) {
@@ -135,11 +135,31 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         domStat->append(&domains[i].profIncomingCrossingSims);
         domStat->append(&domains[i].profIncomingCrossingHist);
 #endif
+#if PROFILE_DOMAIN_TIME
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+#endif
+        new (&domains[i].profEvents) Counter();
+        domains[i].profEvents.init("evs", "Events simulated (weave load)");
+        domStat->append(&domains[i].profEvents);
         objStat->append(domStat);
     }
+    static const char* stateNames[] = {"wait", "busy", "steal", "idle"};
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Simulation thread stats");
+        new (&simThreads[i].profState) TimeBreakdownStat();
+        simThreads[i].profState.init("state", "Time waiting for a phase, simulating home domains, simulating stolen domains, "
+                "and idle (ns)", TH_NUM_STATES, stateNames);
+        thStat->append(&simThreads[i].profState);
+        new (&simThreads[i].profSteals) Counter();
+        simThreads[i].profSteals.init("steals", "Domains stolen from other threads");
+        thStat->append(&simThreads[i].profSteals);
+        objStat->append(thStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -150,12 +170,12 @@ void ContentionSim::simulatePhase(uint64_t limit) {
     assert(limit >= lastLimit);
 
     //info("simulatePhase limit %ld", limit);
-    for (uint32_t i = 0; i < zinfo->numCores; i++) {
-        TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
-        if (tcore) tcore->cSimStart();
-        OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
-        if (ocore) ocore->cSimStart();
+    for (uint32_t i = 0; i < numDomains; i++) {
+        assert(!domains[i].busy);
+        domains[i].done = false;
     }
+    domainsLeft = numDomains;
+    startsLeft = numSimThreads;
 
     inCSim = true;
     __sync_synchronize();
@@ -171,13 +191,15 @@ void ContentionSim::simulatePhase(uint64_t limit) {
     inCSim = false;
     __sync_synchronize();
 
-    for (uint32_t i = 0; i < zinfo->numCores; i++) {
-        TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
-        if (tcore) tcore->cSimEnd();
-        OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
-        if (ocore) ocore->cSimEnd();
+    lastPhaseCrossings = 0;
+    for (uint32_t i = 0; i < numDomains; i++) {
+        lastPhaseCrossings += domains[i].phaseCrossings;
+        domains[i].phaseCrossings = 0;
     }
 
+    lastPhaseSkew = 0;
+    for (uint32_t i = 0; i < numSimThreads; i++) lastPhaseSkew += simThreads[i].phaseSkew;
+
     lastLimit = limit;
     __sync_synchronize();
 }
@@ -187,7 +209,7 @@ void ContentionSim::enqueue(TimingEvent* ev, uint64_t cycle) {
     assert(ev);
     assert_msg(cycle >= lastLimit, "Enqueued event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+1000000, "Queued event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
 
     assert_msg(cycle >= domains[ev->domain].curCycle, "Queued event goes back in time, cycle %ld curCycle %ld", cycle, domains[ev->domain].curCycle);
     ev->privCycle = cycle;
@@ -202,18 +224,41 @@ void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
     assert(!inCSim);
     assert(ev && ev->domain != -1);
     assert(ev->domain < (int32_t)numDomains);
-    uint32_t domain = ev->domain;
-
-    futex_lock(&domains[domain].pqLock);
+    DomainData& domain = domains[ev->domain];
 
     assert_msg(cycle >= lastLimit, "Enqueued (synced) event before last limit! cycle %ld min %ld", cycle, lastLimit);
     //Hacky, but helpful to chase events scheduled too far ahead due to bugs (e.g., cycle -1). We should probably formalize this a bit more
-    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->maxPhaseLength+10000, "Queued  (synced) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
     ev->privCycle = cycle;
     assert(ev->numParents == 0);
-    domains[ev->domain].pq.enqueue(ev, cycle);
+    assert(!ev->next);
+
+    //Push to the domain's inbox. Nothing pops until phase 2, so there is no ABA
+    TimingEvent* head;
+    do {
+        head = domain.inbox;
+        ev->next = head;
+    } while (!__sync_bool_compare_and_swap(&domain.inbox, head, ev));
+}
 
-    futex_unlock(&domains[domain].pqLock);
+// Moves the events enqueued in phase 1 to the domain's pq. Called by the
+// domain's owner; the inbox is reversed first, so events in the same cycle
+// are queued in push order, as if each push had locked the pq.
+void ContentionSim::drainInbox(DomainData& domain) {
+    TimingEvent* ev = __sync_lock_test_and_set(&domain.inbox, nullptr);
+    TimingEvent* rev = nullptr;
+    while (ev) {
+        TimingEvent* next = ev->next;
+        ev->next = rev;
+        rev = ev;
+        ev = next;
+    }
+    while (rev) {
+        TimingEvent* next = rev->next;
+        rev->next = nullptr;
+        domain.pq.enqueue(rev, rev->privCycle);
+        rev = next;
+    }
 }
 
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
@@ -256,18 +301,7 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
 
 void ContentionSim::simThreadLoop(uint32_t thid) {
     info("Started contention simulation thread %d", thid);
-#if 0
-    //Pin
-    uint32_t nprocs = sysconf(_SC_NPROCESSORS_ONLN);
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    //CPU_SET(domain % nprocs, cpuset); //basically no difference
-    //CPU_SET(0, cpuset); CPU_SET(1, cpuset); CPU_SET(2, cpuset); CPU_SET(3, cpuset); //don't use hyperthreads; confuses the scheduler to no end, does worse
-    CPU_SET(thid % nprocs, &cpuset); CPU_SET((thid % nprocs) + (nprocs/2), &cpuset); //pin to a single core but can use both its hyperthreads, works best (~20% gain)
-    //TODO: Must make this optional, or multiple simulations/machine will work horribly
-    int r = sched_setaffinity(0 /*calling thread, equiv to syscall(SYS_gettid)*/, sizeof(cpuset), &cpuset);
-    assert_msg(r == 0, "sched_setaffinity failed (%d)", r);
-#endif
+    zinfo->hostPlacement->pinSimThread(thid); //no-op unless sim.hostPlacement.simCpus is set
     while (true) {
         futex_lock_nospin(&simThreads[thid].wakeLock);
 
@@ -289,130 +323,149 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
 }
 
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
-    uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
-    uint32_t numFinished = 0;
-	//printf("thDomains = %d\n", thDomains);
-    if (thDomains == 1) {
-        DomainData& domain = domains[simThreads[thid].firstDomain];
-        domain.profTime.start();
-        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
-        while (pq.size() && pq.firstCycle() < limit) {
-            uint64_t domCycle = domain.curCycle;
-            uint64_t cycle;
-            TimingEvent* te = pq.dequeue(cycle);
-			//printf("cycle=%ld, domain=%d, numChild=%d, preDelay=%d, postDelay=%d, minStart=%ld\n",
-			//	cycle, te->getDomain(), te->getNumChildren(), te->getPreDelay(), te->getPostDelay(),
-			//	te->getMinStartCycle());
-            assert(cycle >= domCycle);
-            if (cycle != domCycle) {
-                domCycle = cycle;
-                domain.curCycle = cycle;
-            }
-            te->run(cycle);
-            uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
-            assert(newCycle >= domCycle);
-            if (newCycle != domCycle) domain.curCycle = newCycle;
-#if POST_MORTEM
-            simThreads[thid].logVec.push_back(std::make_pair(cycle, te));
-#endif
+    SimThreadData& th = simThreads[thid];
+    th.profState.transition(TH_IDLE);
+    uint32_t homeDomains = th.supDomain - th.firstDomain;
+
+    // Phase start actions run in parallel, each thread on its share of
+    // cores; no domain may run until all of them are done
+    uint32_t numCores = phaseCores.size();
+    uint32_t firstCore = thid*numCores/numSimThreads;
+    uint32_t supCore = (thid+1)*numCores/numSimThreads;
+    for (uint32_t i = firstCore; i < supCore; i++) phaseCores[i]->cSimStart();
+    __sync_fetch_and_sub(&startsLeft, 1);
+    while (startsLeft) _mm_pause();
+
+    // Each domain is simulated by one thread at a time, in its own event
+    // order; crossings only read other domains' curCycle, so a domain may
+    // move to another thread whenever it is released. Threads run their home
+    // domains, and steal not-done domains once all their home domains are
+    // done. Domains are released when they stall on a crossing, so the
+    // domain they wait on can run.
+    while (domainsLeft) {
+        bool homeLeft = false;
+        bool ran = false;
+        for (uint32_t i = 0; i < homeDomains; i++) {
+            uint32_t d = th.firstDomain + i;
+            if (domains[d].done) continue;
+            homeLeft = true;
+            ran |= runDomain(thid, d);
         }
-        domain.curCycle = limit;
-        domain.profTime.end();
 
-#if POST_MORTEM
-        //Post-mortem
-        if (limit % 10000000 == 0)  {
-            futex_lock(&postMortemLock); //serialize output
-            uint32_t uniqueEvs = 0;
-            std::unordered_map<TimingEvent*, std::string> evsSeen;
-            for (std::pair<uint64_t, TimingEvent*> p : simThreads[thid].logVec) {
-                uint64_t cycle = p.first;
-                TimingEvent* te = p.second;
-                std::string desc = evsSeen[te];
-                if (desc == "") { //non-existnt
-                    std::stringstream ss;
-                    ss << uniqueEvs << " " << typeid(*te).name();
-                    CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
-                    if (ce) {
-                        ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
-                    }
-
-                    evsSeen[te] = ss.str();
-                    uniqueEvs++;
-                    desc = ss.str();
-                }
-                info("[%d] %ld %s", thid, cycle, desc.c_str());
+        if (!homeLeft) {
+            for (uint32_t i = 1; i <= numDomains && domainsLeft; i++) {
+                uint32_t d = (th.supDomain + numDomains - 1 + i) % numDomains;  // start after our range
+                if (d >= th.firstDomain && d < th.supDomain) continue;
+                if (domains[d].done) continue;
+                ran |= runDomain(thid, d);
             }
-            futex_unlock(&postMortemLock);
         }
-        simThreads[thid].logVec.clear();
-#endif
-
-    } else {
-        //info("XXX %d / %d %d %d", thid, thDomains, simThreads[thid].supDomain, simThreads[thid].firstDomain);
 
-        std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
-        for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
-            domPq.push(&domains[i]);
+        if (!ran) {
+            th.profState.transition(TH_IDLE);
+            _mm_pause();
         }
+    }
 
-        std::vector<DomainData*> sq1;
-        std::vector<DomainData*> sq2;
-
-        std::vector<DomainData*>& stalledQueue = sq1;
-        std::vector<DomainData*>& nextStalledQueue = sq2;
-
-        while (numFinished < thDomains) {
-            while (domPq.size()) {
-                DomainData* domain = domPq.top();
-                domPq.pop();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("YYY %d %ld %ld %d", numFinished, domPq.size(), domain->curCycle, domain->prio);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->run(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else stalledQueue.push_back(domain);
-                }
-            }
+    // All domains are done, so every core's events for this phase have run
+    th.phaseSkew = 0;
+    for (uint32_t i = firstCore; i < supCore; i++) {
+        Core* core = phaseCores[i];
+        uint64_t cycles = core->getCycles();
+        core->cSimEnd();
+        th.phaseSkew += core->getCycles() - cycles;
+    }
+    th.profState.transition(TH_WAIT);
 
-            while (stalledQueue.size()) {
-                DomainData* domain = stalledQueue.back();
-                stalledQueue.pop_back();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("SSS %d %ld %ld", numFinished, stalledQueue.size(), domain->curCycle);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->state = EV_RUNNING;
-                    te->simulate(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else nextStalledQueue.push_back(domain);
+#if POST_MORTEM
+    //Post-mortem
+    if (limit % 10000000 == 0)  {
+        futex_lock(&postMortemLock); //serialize output
+        uint32_t uniqueEvs = 0;
+        std::unordered_map<TimingEvent*, std::string> evsSeen;
+        for (std::pair<uint64_t, TimingEvent*> p : th.logVec) {
+            uint64_t cycle = p.first;
+            TimingEvent* te = p.second;
+            std::string desc = evsSeen[te];
+            if (desc == "") { //non-existnt
+                std::stringstream ss;
+                ss << uniqueEvs << " " << typeid(*te).name();
+                CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
+                if (ce) {
+                    ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
                 }
-                if (domPq.size()) break;
+
+                evsSeen[te] = ss.str();
+                uniqueEvs++;
+                desc = ss.str();
             }
-            if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
+            info("[%d] %ld %s", thid, cycle, desc.c_str());
         }
+        futex_unlock(&postMortemLock);
     }
+    th.logVec.clear();
+#endif
 
     //info("Phase done");
     __sync_synchronize();
 }
 
+// Simulates domainIdx until it is done or stalls on a crossing. Returns
+// false if another thread owns it or it was done already.
+bool ContentionSim::runDomain(uint32_t thid, uint32_t domainIdx) {
+    DomainData& domain = domains[domainIdx];
+    if (domain.busy || !__sync_bool_compare_and_swap(&domain.busy, 0, 1)) return false;
+    if (domain.done) {  // finished by the previous owner
+        __sync_lock_release(&domain.busy);
+        return false;
+    }
+
+    SimThreadData& th = simThreads[thid];
+    bool stolen = domainIdx < th.firstDomain || domainIdx >= th.supDomain;
+    th.profState.transition(stolen? TH_STEAL : TH_BUSY);
+    if (stolen) th.profSteals.inc();
+
+#if PROFILE_DOMAIN_TIME
+    domain.profTime.start();
+#endif
+    if (domain.inbox) drainInbox(domain);
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
+    // Threads with several home domains have always run events at the limit
+    // cycle in this phase, and single-domain threads in the next one
+    uint64_t doneCycle = domain.runAtLimit? limit + 1 : limit;
+    while (true) {
+        if (!pq.size() || pq.firstCycle() >= doneCycle) {
+            domain.curCycle = limit;
+            domain.done = true;
+            __sync_fetch_and_sub(&domainsLeft, 1);
+            break;
+        }
+        uint64_t domCycle = domain.curCycle;
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        assert(cycle >= domCycle);
+        if (cycle != domCycle) {
+            domCycle = cycle;
+            domain.curCycle = cycle;
+        }
+        te->run(cycle);
+        domain.profEvents.inc();
+        uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
+        assert(newCycle >= domCycle);
+        if (newCycle != domCycle) domain.curCycle = newCycle;
+#if POST_MORTEM
+        th.logVec.push_back(std::make_pair(cycle, te));
+#endif
+        if (domain.prio) break;  // waiting on another domain, let it run
+    }
+#if PROFILE_DOMAIN_TIME
+    domain.profTime.end();
+#endif
+
+    __sync_lock_release(&domain.busy);  // release barrier: our updates are visible to the next owner
+    return true;
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -43,6 +43,11 @@
 #define PROFILE_CROSSINGS 0
 //#define PROFILE_CROSSINGS 1
 
+//Set to 1 to time each domain's weave simulation. Reads the clock every time a domain is run, so it adds overhead.
+#define PROFILE_DOMAIN_TIME 0
+//#define PROFILE_DOMAIN_TIME 1
+
+class Core;
 class TimingEvent;
 class DelayEvent;
 class CrossingEvent;
@@ -68,15 +73,20 @@ class ContentionSim : public GlobAlloc {
             PAD();
 
             volatile uint64_t curCycle;
-            lock_t pqLock; //used on phase 1 enqueues
-            //lock_t domainLock; //used by simulation thread
+            TimingEvent* volatile inbox; //phase 1 enqueues, a lock-free LIFO linked through TimingEvent::next; moved to pq by the domain's owner in phase 2
+            volatile uint32_t busy; //set while a simulation thread owns the domain (phase 2)
+            volatile bool done; //reached the phase limit
+            bool runAtLimit; //also runs events at the limit cycle; set on domains of threads with several home domains
 
-            uint32_t prio;
-            uint64_t queuePrio;
+            uint32_t prio; //non-zero while stalled on a crossing
 
             PAD();
 
+#if PROFILE_DOMAIN_TIME
             ClockStat profTime;
+#endif
+            Counter profEvents;
+            uint64_t phaseCrossings; //crossings completed in this phase
 
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
@@ -85,21 +95,30 @@ class ContentionSim : public GlobAlloc {
 #endif
         };
 
-        struct CompareDomains : public std::binary_function<DomainData*, DomainData*, bool> {
-             bool operator()(DomainData* d1, DomainData* d2) const;
-        };
+        //Simulation thread states, for profiling
+        enum ThreadState {TH_WAIT, TH_BUSY, TH_STEAL, TH_IDLE, TH_NUM_STATES};
 
         struct SimThreadData {
             lock_t wakeLock; //used to sleep/wake up simulation thread
-            uint32_t firstDomain;
+            uint32_t firstDomain; //home domains; other domains are stolen once these are done
             uint32_t supDomain; //supreme, ie first not included
 
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
+
+            uint64_t phaseSkew; //weave-phase delay added to this thread's share of phaseCores
+
+            PAD();
+
+            TimeBreakdownStat profState;
+            Counter profSteals;
+
+            PAD();
         };
 
         //RO
         DomainData* domains;
         SimThreadData* simThreads;
+        g_vector<Core*> phaseCores; //get cSimStart()/cSimEnd() calls; each sim thread handles a contiguous share
 
         PAD();
 
@@ -116,10 +135,16 @@ class ContentionSim : public GlobAlloc {
         volatile bool terminate;
 
         volatile uint32_t threadsDone;
+        volatile uint32_t domainsLeft; //not yet done in this phase
+        volatile uint32_t startsLeft; //sim threads still running cSimStart() on their cores
         volatile uint32_t threadTicket; //used only at init
 
         volatile bool inCSim; //true when inside contention simulation
 
+        //Bound/weave interaction in the last phase, for adaptive phase lengths
+        uint64_t lastPhaseCrossings;
+        uint64_t lastPhaseSkew; //weave-phase delay added to all cores
+
         PAD();
 
         //lock_t testLock;
@@ -132,6 +157,12 @@ class ContentionSim : public GlobAlloc {
 
         void postInit(); //must be called after the simulator is initialized
 
+        //Places state simulated in this domain on the host node of the domain's home thread (see HostPlacement)
+        void placeOnDomainNode(const void* ptr, size_t bytes, uint32_t domain);
+
+        //Registers a core whose timing model takes part in the weave phase; called once, at init
+        void registerCore(Core* core) {phaseCores.push_back(core);}
+
         void enqueue(TimingEvent* ev, uint64_t cycle);
         void enqueueSynced(TimingEvent* ev, uint64_t cycle);
         void enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec);
@@ -151,6 +182,12 @@ class ContentionSim : public GlobAlloc {
 
         void setPrio(uint32_t domain, uint32_t prio) {domains[domain].prio = prio;}
 
+        //Called by the domain's owner
+        void countCrossing(uint32_t domain) {domains[domain].phaseCrossings++;}
+
+        uint64_t getPhaseCrossings() const {return lastPhaseCrossings;}
+        uint64_t getPhaseSkew() const {return lastPhaseSkew;}
+
 #if PROFILE_CROSSINGS
         void profileCrossing(uint32_t srcDomain, uint32_t dstDomain, uint32_t count) {
             domains[dstDomain].profIncomingCrossings.inc(srcDomain);
@@ -162,6 +199,8 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        bool runDomain(uint32_t thid, uint32_t domainIdx);
+        void drainInbox(DomainData& domain);
 
         static void SimThreadTrampoline(void* arg);
 };
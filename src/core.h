@@ -84,6 +84,10 @@ class Core : public GlobAlloc {
         virtual void leave() {}
         virtual void join() {}
 
+        //Called by ContentionSim at the start and end of each weave phase, on cores registered with registerCore()
+        virtual void cSimStart() {}
+        virtual void cSimEnd() {}
+
         virtual InstrFuncPtrs GetFuncPtrs() = 0;
 };
 
@@ -25,6 +25,7 @@
 
 #include "ddr_mem.h"
 #include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 #include "bithacks.h"
@@ -44,13 +45,16 @@ class DDRMemoryAccEvent : public TimingEvent {
         Address addr;
 		uint32_t data_size;
         bool write;
+        uint8_t accClass;
     public:
-        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, int32_t domain, uint32_t preDelay, uint32_t postDelay)
-            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite) {}
+        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _data_size, int32_t domain, uint32_t preDelay, uint32_t postDelay,
+                DDRMemory::AccessClass _accClass = DDRMemory::ACC_OTHER)
+            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), data_size(_data_size), write(_isWrite), accClass(_accClass) {}
 
         Address getAddr() const {return addr;}
         bool isWrite() const {return write;}
 		uint32_t getDataSize() const {return data_size;}
+        uint8_t getAccClass() const {return accClass;}
         void simulate(uint64_t startCycle) {
             mem->enqueue(this, startCycle);
         }
@@ -151,6 +155,56 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
 
 /* Init & bound phase functionality */
 
+DDRMemoryConfig::DDRMemoryConfig(Config& config, const std::string& prefix) {
+    ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
+    banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
+    pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
+    tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see initTech for other techs
+    addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
+    bankXorHash = config.get<bool>(prefix + "bankXorHash", false);  // XOR bank bits with low row bits
+
+    // If set, writes are deferred and bursted out to reduce WTR overheads
+    deferWrites = config.get<bool>(prefix + "deferWrites", true);
+    closedPage = config.get<bool>(prefix + "closedPage", true);
+    // Row buffer policy: closed, open, timeout (precharge after rowTimeout idle mem cycles), or
+    // predict (per-bank 2-bit row hit predictor, rows kept open for at most rowTimeout, 0 is unlimited)
+    std::string rowPolicyStr = config.get<const char*>(prefix + "rowPolicy", closedPage? "closed" : "open");
+    rowTimeout = config.get<uint32_t>(prefix + "rowTimeout", 64);
+    if (rowPolicyStr == "closed") rowPolicy = DDRMemory::ROW_CLOSED;
+    else if (rowPolicyStr == "open") rowPolicy = DDRMemory::ROW_OPEN;
+    else if (rowPolicyStr == "timeout") rowPolicy = DDRMemory::ROW_TIMEOUT;
+    else if (rowPolicyStr == "predict") rowPolicy = DDRMemory::ROW_PREDICT;
+    else panic("Invalid %srowPolicy %s (closed/open/timeout/predict)", prefix.c_str(), rowPolicyStr.c_str());
+
+    // Max row hits before we stop prioritizing further row hits to this bank.
+    // Balances throughput and fairness; 0 -> FCFS / high (e.g., -1) -> pure FR-FCFS
+    maxRowHits = config.get<uint32_t>(prefix + "maxRowHits", 4);
+
+    // Request queues
+    queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
+    controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);
+
+    // Bulk transfers (page fills and writebacks): if non-zero, split transfers larger than this many
+    // 16-byte bursts into chunks within one row, queued at most bulkMaxChunks at a time. With
+    // bulkDemandFirst, ready demand requests are scheduled before ready chunks.
+    bulkChunkBursts = config.get<uint32_t>(prefix + "bulkChunkBursts", 0);
+    bulkMaxChunks = config.get<uint32_t>(prefix + "bulkMaxChunks", 4);
+    bulkDemandFirst = config.get<bool>(prefix + "bulkDemandFirst", true);
+
+    // Write drains start above wrHighWatermark writes queued and stop at wrLowWatermark. Adaptive
+    // drains also start early on an idle data bus, and yield to reads once drainReadLimit wait.
+    // writeBufferLines bounds posted but unissued writes (0 is unbounded); writes to a full buffer are
+    // accepted, and their issuer resumes, once enough has drained (see writeAcceptCycle()).
+    wrHighWatermark = config.get<uint32_t>(prefix + "wrHighWatermark", 3*queueDepth/4);
+    wrLowWatermark = config.get<uint32_t>(prefix + "wrLowWatermark", queueDepth/4);
+    adaptiveDrain = config.get<bool>(prefix + "adaptiveDrain", false);
+    drainReadLimit = config.get<uint32_t>(prefix + "drainReadLimit", queueDepth/2);
+    writeBufferLines = config.get<uint32_t>(prefix + "writeBufferLines", 0);
+
+    // Ranks idle for this many memory cycles power down; their next command pays tXP (0 disables)
+    powerDownIdle = config.get<uint32_t>(prefix + "powerDownIdle", 0);
+}
+
 DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
         uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
         uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
@@ -161,11 +215,11 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
 {
     sysFreqKHz = 1000 * _sysFreqMHz;
     initTech(tech, time_scale);  // sets all tXX and memFreqKHz
-	tBL = _tBL;
-    if (memFreqKHz >= sysFreqKHz/2) {
-        panic("You may need to tweak the scheduling code, which works with system cycles." \
-            "With these frequencies, events (which run on system cycles) can't hit us every memory cycle.");
-    }
+	if (_tBL) tBL = _tBL;
+    // Scheduling events run on system cycles. With a memory clock at or above half
+    // the system clock, they cannot hit every memory cycle, so ticks run on the
+    // first system cycle at or after the memory cycle they were scheduled for
+    fastMemClock = memFreqKHz >= sysFreqKHz/2;
 
     //minRdLatency = controllerSysLatency + memToSysCycle(tCL+tBL-1);
     minRdLatency = controllerSysLatency + memToSysCycle(tCL+2-1);
@@ -182,12 +236,44 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
 
     minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
 
-    banks.resize(ranksPerChannel);
-    for (uint32_t i = 0; i < ranksPerChannel; i++) banks[i].resize(banksPerRank);
+    banks = gm_page_alloc<Bank>(ranksPerChannel*banksPerRank);
+    for (uint32_t i = 0; i < ranksPerChannel*banksPerRank; i++) new (&banks[i]) Bank();
+    for (HeadTracker& ht : headTrackers) {
+        ht.pending.init(ranksPerChannel*banksPerRank);
+        ht.ready.init(ranksPerChannel*banksPerRank);
+        ht.active = false;
+    }
+    nextQueueSeq = 0;
+
+    bulkChunkBursts = 0;
+    bulkMaxChunks = 4;
+    bulkDemandFirst = true;
+    bulkChunksInFlight = 0;
+    bankXorHash = false;
+    rowPolicy = closedPage? ROW_CLOSED : ROW_OPEN;
+    rowTimeout = 0;
+    wrHighWatermark = 3*queueDepth/4;
+    wrLowWatermark = queueDepth/4;
+    adaptiveDrain = false;
+    drainReadLimit = queueDepth/2;
+    writeBufferBursts = 0;
+    wrBufferedBursts = 0;
+    wrPostedDrainCycle = 0;
+    draining = false;
+    drainStartCycle = 0;
+    powerDownIdle = 0;
+    rankPower.resize(ranksPerChannel, RankPowerState{0, 0, false});
 
     rankActWindows.resize(ranksPerChannel);
     for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
 
+    if (banksPerRank % bankGroups) panic("%s: %d banks/rank not divisible in %d bank groups", name.c_str(), banksPerRank, bankGroups);
+    rankLastActCycle.resize(ranksPerChannel, 0);
+    rankLastCasCycle.resize(ranksPerChannel, 0);
+    groupLastActCycle.resize(ranksPerChannel*bankGroups, 0);
+    groupLastCasCycle.resize(ranksPerChannel*bankGroups, 0);
+    nextRefreshBank = 0;
+
     // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
     uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
     uint32_t bankBits = ilog2(banksPerRank);
@@ -221,13 +307,25 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
             ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift);
 
     // Weave phase events
-    new RefreshEvent(this, memToSysCycle(tREFI), domain);
+    new RefreshEvent(this, memToSysCycle(tRFCpb? tREFI/(ranksPerChannel*banksPerRank) : tREFI), domain);
 
     nextSchedCycle = -1ul;
     nextSchedEvent = nullptr;
     eventFreelist = nullptr;
 }
 
+void DDRMemory::placeOnDomainNode() {
+    ContentionSim* cs = zinfo->contentionSim;
+    cs->placeOnDomainNode(this, hostPageBytes(sizeof(DDRMemory)), domain);
+    cs->placeOnDomainNode(banks, hostPageBytes(sizeof(Bank)*ranksPerChannel*banksPerRank), domain);
+    cs->placeOnDomainNode(rdQueue.storage(), rdQueue.storageBytes(), domain);
+    cs->placeOnDomainNode(wrQueue.storage(), wrQueue.storageBytes(), domain);
+    for (HeadTracker& ht : headTrackers) {
+        cs->placeOnDomainNode(ht.pending.storage(), ht.pending.storageBytes(), domain);
+        cs->placeOnDomainNode(ht.ready.storage(), ht.ready.storageBytes(), domain);
+    }
+}
+
 void DDRMemory::initStats(AggregateStat* parentStat) {
     AggregateStat* memStats = new AggregateStat();
     memStats->init(name.c_str(), "Memory controller stats");
@@ -239,6 +337,47 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
+    profBulkXfers.init("bulk", "Bulk transfers split into chunks"); memStats->append(&profBulkXfers);
+    profBulkChunks.init("bulkChunks", "Bulk transfer chunks"); memStats->append(&profBulkChunks);
+    profBulkHits.init("bulkHits", "Bulk transfer chunk row hits"); memStats->append(&profBulkHits);
+    profDrains.init("drains", "Write drain episodes"); memStats->append(&profDrains);
+    profDrainCycles.init("drainCycles", "Memory cycles spent draining writes"); memStats->append(&profDrainCycles);
+    profWtrTurnarounds.init("wtrTurns", "Write to read turnarounds"); memStats->append(&profWtrTurnarounds);
+    profWtrCycles.init("wtrCycles", "Memory cycles reads waited for tWTR"); memStats->append(&profWtrCycles);
+    profRowHits.init("rowHits", "Row buffer hits per bank", ranksPerChannel*banksPerRank); memStats->append(&profRowHits);
+    profRowConflicts.init("rowConflicts", "Row buffer conflicts (other row open) per bank", ranksPerChannel*banksPerRank); memStats->append(&profRowConflicts);
+    profRowEmpty.init("rowEmpty", "Accesses to a precharged bank per bank", ranksPerChannel*banksPerRank); memStats->append(&profRowEmpty);
+    profActs.init("acts", "ACT commands"); memStats->append(&profActs);
+    profRdBurstCycles.init("rdBurstCycles", "Data bus cycles transferring read data"); memStats->append(&profRdBurstCycles);
+    profWrBurstCycles.init("wrBurstCycles", "Data bus cycles transferring write data"); memStats->append(&profWrBurstCycles);
+    profRefreshes.init("refs", "All-bank refreshes (one per rank)"); memStats->append(&profRefreshes);
+    profBankRefreshes.init("bankRefs", "Per-bank refreshes"); memStats->append(&profBankRefreshes);
+    profActStbyCycles.init("actStbyCycles", "Rank cycles in active standby (some row open)"); memStats->append(&profActStbyCycles);
+    profPreStbyCycles.init("preStbyCycles", "Rank cycles in precharge standby (all rows closed)"); memStats->append(&profPreStbyCycles);
+    profActPdCycles.init("actPdCycles", "Rank cycles in active power-down"); memStats->append(&profActPdCycles);
+    profPrePdCycles.init("prePdCycles", "Rank cycles in precharge power-down"); memStats->append(&profPrePdCycles);
+    profPdExits.init("pdExits", "Power-down exits"); memStats->append(&profPdExits);
+    const char* classNames[] = {"other", "tag", "data", "fill", "evict", "counter"};
+    static_assert(sizeof(classNames)/sizeof(classNames[0]) == NUM_ACC_CLASSES, "Missing access class names");
+    profClassReqs.init("classReqs", "Commands per access class (DRAM cache tag/data/fill/evict/counter)", NUM_ACC_CLASSES, classNames); memStats->append(&profClassReqs);
+    profClassRowHits.init("classRowHits", "Row buffer hits per access class", NUM_ACC_CLASSES, classNames); memStats->append(&profClassRowHits);
+
+    // Energies in pJ, power in mW (pJ/ns)
+    auto addEnergyStat = [this, memStats](const char* statName, const char* desc, std::function<double()> f) {
+        auto stat = makeLambdaStat([f]() -> uint64_t { return (uint64_t)f(); });
+        stat->init(statName, desc);
+        memStats->append(stat);
+    };
+    addEnergyStat("actEnergy", "ACT/PRE energy (pJ)", [this]() { return actEnergy(); });
+    addEnergyStat("rdEnergy", "Read burst energy (pJ)", [this]() { return rdEnergy(); });
+    addEnergyStat("wrEnergy", "Write burst energy (pJ)", [this]() { return wrEnergy(); });
+    addEnergyStat("refEnergy", "Refresh energy (pJ)", [this]() { return refEnergy(); });
+    addEnergyStat("bgEnergy", "Background (standby and power-down) energy (pJ)", [this]() { return bgEnergy(); });
+    addEnergyStat("energy", "Total DRAM energy (pJ)", [this]() { return getEnergy(); });
+    addEnergyStat("avgPower", "Average DRAM power (mW)", [this]() {
+        double ns = getElapsedNs();
+        return ns? getEnergy()/ns : 0.0;
+    });
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); 
 	// XXX //memStats->append(&latencyHist);
     parentStat->append(memStats);
@@ -267,13 +406,13 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
     } else {
         bool isWrite = (req.type == PUTX);
 		// TODO If length > 1 cacheline, add 4 cycle for each cacheline
-        uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency) + memToSysCycle(data_size - 1);
+        uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency) + memToSysCycle(busCycles(data_size) - 1);
         if (zinfo->eventRecorders[req.srcId]) {
 			// accessing multiple lines is modeled as multiple requests.
 			// All the requests can be processed in parallel.
 			//  
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
-                    isWrite, req.lineAddr, data_size, domain, preDelay, isWrite? postDelayWr : postDelayRd);
+                    isWrite, req.lineAddr, data_size, domain, preDelay, isWrite? postDelayWr : postDelayRd, accessClass(req));
 			if (type == 0) // default. The only record. 
             {
             	memEv->setMinStartCycle(req.cycle);
@@ -311,7 +450,7 @@ uint64_t DDRMemory::access(MemReq& req, int type, uint32_t data_size) {
 
 //Address mapping:
 // For now, row:col:bank:rank:channel for max parallelism (same as scheme7 from DRAMSim)
-// NOTE: channel is external (from SplitAddrMem)
+// NOTE: channel is external (from MultiChannelMemory)
 // Change or reorder to define your own mappings
 DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     AddrLoc l;
@@ -319,6 +458,10 @@ DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     l.rank = (lineAddr >> rankShift) & rankMask;
     l.bank = (lineAddr >> bankShift) & bankMask;
     l.row  = lineAddr >> rowShift;
+    // Permutation-based interleaving: rows that would conflict in one bank
+    // (same bank bits, different rows) spread over all banks. Lines of the
+    // same row still share a bank, so row hits are unchanged.
+    if (bankXorHash) l.bank ^= l.row & bankMask;
 
     //info("0x%lx r%ld:c%d b%d:r%d", lineAddr, l.row, l.col, l.bank, l.rank);
     assert(l.rank < ranksPerChannel);
@@ -327,9 +470,72 @@ DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     return l;
 }
 
+void DDRMemory::setBulkPolicy(uint32_t chunkBursts, uint32_t maxChunks, bool demandFirst) {
+    uint32_t burstsPerLine = lineSize/16;
+    if (chunkBursts && chunkBursts < burstsPerLine) {
+        panic("%s: bulk chunks (%d bursts) must hold at least a line (%d bursts)", name.c_str(), chunkBursts, burstsPerLine);
+    }
+    if (chunkBursts && !maxChunks) panic("%s: need at least one bulk chunk in flight", name.c_str());
+    bulkChunkBursts = chunkBursts;
+    bulkMaxChunks = maxChunks;
+    bulkDemandFirst = demandFirst;
+}
+
+void DDRMemory::setPolicies(const DDRMemoryConfig& cfg) {
+    setBulkPolicy(cfg.bulkChunkBursts, cfg.bulkMaxChunks, cfg.bulkDemandFirst);
+    setBankXorHash(cfg.bankXorHash);
+    setRowPolicy(cfg.rowPolicy, cfg.rowTimeout);
+    setPowerDown(cfg.powerDownIdle);
+    setWritePolicy(cfg.wrHighWatermark, cfg.wrLowWatermark, cfg.adaptiveDrain, cfg.drainReadLimit, cfg.writeBufferLines);
+}
+
+void DDRMemory::setRowPolicy(RowPolicy policy, uint32_t timeout) {
+    if (policy == ROW_TIMEOUT && !timeout) panic("%s: timeout row policy needs a non-zero rowTimeout", name.c_str());
+    rowPolicy = policy;
+    rowTimeout = timeout;
+}
+
+void DDRMemory::setWritePolicy(uint32_t highWatermark, uint32_t lowWatermark, bool adaptive, uint32_t readLimit, uint32_t bufferLines) {
+    if (lowWatermark >= highWatermark || highWatermark > queueDepth) {
+        panic("%s: need write watermarks low (%d) < high (%d) <= queueDepth (%d)", name.c_str(), lowWatermark, highWatermark, queueDepth);
+    }
+    wrHighWatermark = highWatermark;
+    wrLowWatermark = lowWatermark;
+    adaptiveDrain = adaptive;
+    drainReadLimit = readLimit;
+    writeBufferBursts = (uint64_t)bufferLines*(lineSize/16);
+}
+
+uint64_t DDRMemory::writeAcceptCycle(Address lineAddr, uint64_t sysCycle, uint32_t data_size) {
+    if (!writeBufferBursts) return sysCycle;
+    // Occupancy, in data bus cycles, is what the bus cannot have drained yet
+    // of the writes posted so far in the bound phase, or what the last weave
+    // phase left unissued if that is more (it also sees reads slowing drains)
+    uint64_t memCycle = sysToMemCycle(sysCycle);
+    uint64_t postedCycles = (wrPostedDrainCycle > memCycle)? wrPostedDrainCycle - memCycle : 0;
+    uint64_t occupancy = std::max(postedCycles, (uint64_t)busCycles(wrBufferedBursts));
+    uint64_t capacity = busCycles(writeBufferBursts);
+    uint64_t writeCycles = busCycles(data_size);
+
+    // A full buffer accepts the write once enough of it has drained
+    uint64_t acceptCycle = memCycle;
+    if (occupancy + writeCycles > capacity) acceptCycle += occupancy + writeCycles - capacity;
+    wrPostedDrainCycle = std::max(wrPostedDrainCycle, acceptCycle) + writeCycles;
+    return (acceptCycle == memCycle)? sysCycle : memToSysCycle(acceptCycle);
+}
+
 void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
     DEBUG("%ld: enqueue() addr 0x%lx wr %d", memCycle, ev->getAddr(), ev->isWrite());
+    if (ev->isWrite()) wrBufferedBursts += ev->getDataSize();
+
+    if (bulkChunkBursts && ev->getDataSize() > bulkChunkBursts) {
+        ev->hold();
+        startBulk(ev, memCycle, sysCycle);
+        uint64_t minSchedCycle = feedBulkChunks(memCycle);
+        if (nextSchedCycle > minSchedCycle) scheduleTick(minSchedCycle, sysCycle);
+        return;
+    }
 
     // Create request
     Request ovfReq;
@@ -345,6 +551,8 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     req->startSysCycle = sysCycle;
 
     req->ev = ev;
+    req->bulk = nullptr;
+    req->accClass = ev->getAccClass();
     ev->hold();
 
     if (overflow) {
@@ -357,29 +565,156 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
 			// XXX I don't know what this code is doing, but just adding data_size anyway.
             uint64_t minSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL); // * req->data_size);
             if (nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(*req));
-            if (nextSchedCycle > minSchedCycle) {
-                if (nextSchedEvent) nextSchedEvent->annul();
-                if (eventFreelist) {
-                    nextSchedEvent = eventFreelist;
-                    eventFreelist = eventFreelist->next;
-                    nextSchedEvent->next = nullptr;
-                } else {
-                    nextSchedEvent = new SchedEvent(this, domain);
-                }
-                DEBUG("queued %ld", minSchedCycle);
+            if (nextSchedCycle > minSchedCycle) scheduleTick(minSchedCycle, sysCycle);
+        }
+    }
+}
 
-                // Under memFreq < sysFreq/2, sysToMemCycle translates back to the same memCycle
-                uint64_t enqSysCycle = std::max(matchingMemToSysCycle(minSchedCycle), sysCycle);
-                nextSchedEvent->enqueue(enqSysCycle);
-                nextSchedCycle = minSchedCycle;
-            }
+// Moves our next tick earlier, to minSchedCycle
+void DDRMemory::scheduleTick(uint64_t minSchedCycle, uint64_t sysCycle) {
+    assert(minSchedCycle < nextSchedCycle);
+    if (nextSchedEvent) nextSchedEvent->annul();
+    if (eventFreelist) {
+        nextSchedEvent = eventFreelist;
+        eventFreelist = eventFreelist->next;
+        nextSchedEvent->next = nullptr;
+    } else {
+        nextSchedEvent = new SchedEvent(this, domain);
+    }
+    DEBUG("queued %ld", minSchedCycle);
+
+    // sysToMemCycle translates back to the same memCycle (or a later one, see fastMemClock)
+    uint64_t enqSysCycle = std::max(matchingMemToSysCycle(minSchedCycle), sysCycle);
+    nextSchedEvent->enqueue(enqSysCycle);
+    nextSchedCycle = minSchedCycle;
+}
+
+void DDRMemory::startBulk(DDRMemoryAccEvent* ev, uint64_t memCycle, uint64_t sysCycle) {
+    BulkTransfer* bt;
+    if (bulkFreelist.empty()) {
+        bt = new BulkTransfer();
+    } else {
+        bt = bulkFreelist.front();
+        bulkFreelist.pop_front();
+    }
+
+    uint32_t burstsPerLine = lineSize/16;
+    bt->ev = ev;
+    bt->write = ev->isWrite();
+    bt->startLine = ev->getAddr();
+    bt->burstsLeft = ev->getDataSize();
+    bt->linesLeft = (bt->burstsLeft + burstsPerLine - 1)/burstsPerLine;
+    bt->endLine = bt->startLine + bt->linesLeft;
+    bt->scanLine = bt->startLine;
+    bt->inGroup = false;
+    bt->chunksInFlight = 0;
+    bt->startSysCycle = sysCycle;
+    bt->accClass = ev->getAccClass();
+    bulkTransfers.push_back(bt);
+    profBulkXfers.inc();
+}
+
+/* Queues chunks of pending bulk transfers, oldest transfer first, while
+ * there is room. Returns the min cycle at which a new chunk that is first in
+ * its bank queue may issue, or -1ul if there's none.
+ */
+uint64_t DDRMemory::feedBulkChunks(uint64_t memCycle) {
+    uint64_t minSchedCycle = -1ul;
+    while (bulkChunksInFlight < bulkMaxChunks && !bulkTransfers.empty()) {
+        BulkTransfer* bt = bulkTransfers.front();
+        RequestQueue<Request>& q = (deferredWrites && bt->write)? wrQueue : rdQueue;
+        if (q.full()) break;
+
+        Request* req = q.alloc();
+        splitBulkChunk(bt, req);
+        req->write = bt->write;
+        req->startSysCycle = bt->startSysCycle;
+        req->bulk = bt;
+        req->accClass = bt->accClass;
+        // Writes are acknowledged when their first chunk is queued (like
+        // overflowed writes); reads when their last chunk finishes
+        req->ev = (bt->write && bt->ev)? bt->ev : nullptr;
+        if (bt->write) bt->ev = nullptr;
+        bt->chunksInFlight++;
+        bulkChunksInFlight++;
+        profBulkChunks.inc();
+        if (!bt->linesLeft) bulkTransfers.pop_front();  // fully split
+
+        queue(req, memCycle);
+        if (!req->prev /*first in bank queue*/) {
+            uint64_t minCmdCycle = std::max(memCycle, minRespCycle - tCL - tBL);
+            minSchedCycle = std::min(minSchedCycle, std::max(minCmdCycle, findMinCmdCycle(*req)));
         }
     }
+    return minSchedCycle;
+}
+
+// Fills req with the next chunk of bt: lines of the transfer that fall in the same rank, bank and row
+void DDRMemory::splitBulkChunk(BulkTransfer* bt, Request* req) {
+    assert(bt->linesLeft);
+    const Address colStride = 1ul << colShift;
+    auto col = [this](Address line) { return (line >> colShift) & colMask; };
+    if (!bt->inGroup) {
+        // Find the first line of the next group. A line starts a group if
+        // its col is 0 or its col predecessor precedes the transfer; other
+        // lines belong to groups we have already split.
+        Address l = bt->scanLine;
+        while (col(l) && l - colStride >= bt->startLine) l++;
+        assert(l < bt->endLine);
+        bt->scanLine = l + 1;
+        bt->groupLine = l;
+        bt->inGroup = true;
+    }
+
+    uint32_t burstsPerLine = lineSize/16;
+    uint32_t maxLines = bulkChunkBursts/burstsPerLine;
+    Address l = bt->groupLine;
+    req->addr = l;
+    req->loc = mapLineAddr(l);
+    uint32_t lines = 0;
+    do {
+        lines++;
+        l += colStride;
+    } while (lines < maxLines && l < bt->endLine && col(l) /*no carry out of col*/);
+
+    bt->inGroup = l < bt->endLine && col(l);
+    bt->groupLine = l;
+    bt->linesLeft -= lines;
+    req->data_size = bt->linesLeft? lines*burstsPerLine : bt->burstsLeft;
+    assert(bt->burstsLeft >= req->data_size);
+    bt->burstsLeft -= req->data_size;
+}
+
+void DDRMemory::finishBulkChunk(Request* r, bool rowHit, uint64_t sysCycle) {
+    BulkTransfer* bt = r->bulk;
+    assert(bt->chunksInFlight && bulkChunksInFlight);
+    bt->chunksInFlight--;
+    bulkChunksInFlight--;
+    if (rowHit) profBulkHits.inc();
+    (r->write? bytesWrites : bytesReads).inc(16 * r->data_size);
+    if (bt->linesLeft || bt->chunksInFlight) return;
+
+    // Last chunk of the transfer
+    uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
+    uint32_t scDelay = doneSysCycle - bt->startSysCycle;
+    if (bt->write) {
+        profWrites.inc();
+        profTotalWrLat.inc(scDelay);
+    } else {
+        assert(doneSysCycle >= sysCycle);
+        bt->ev->release();
+        bt->ev->done(doneSysCycle - preDelay - postDelayRd);
+        profReads.inc();
+        profTotalRdLat.inc(scDelay);
+        latencyHist.inc(std::min(NUMBINS-1, scDelay/BINSIZE), 1);
+    }
+    bt->ev = nullptr;
+    bulkFreelist.push_back(bt);
 }
 
 void DDRMemory::queue(Request* req, uint64_t memCycle) {
     // If it's a write, respond to it immediately
-    if (req->write) {
+    if (req->write && req->ev) {
         auto ev = req->ev;
         req->ev = nullptr;
 
@@ -389,6 +724,17 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     }
 
     req->arrivalCycle = memCycle;  // if this comes from the overflow queue, update
+    req->queueSeq = nextQueueSeq++;
+
+    // If the rank has powered down, its commands wait tXP for it to wake up.
+    // Arrivals count as activity, so a rank does not power down under requests
+    // that just arrived (though it may if they wait longer than powerDownIdle).
+    uint32_t rank = req->loc.rank;
+    req->pdExitCycle = isPoweredDown(rank, memCycle)? memCycle + tXP : 0;
+    if (powerDownIdle) {
+        samplePower(rank, memCycle);
+        rankPower[rank].lastCmdCycle = std::max(rankPower[rank].lastCmdCycle, memCycle);
+    }
 
     // Test: Skip writes
 #if 0
@@ -400,7 +746,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 #endif
 
     // Alloc in per-bank queue, in FR order
-    Bank& bank = banks[req->loc.rank][req->loc.bank];
+    Bank& bank = banks[req->loc.rank*banksPerRank + req->loc.bank];
     InList<Request>& q = (deferredWrites && req->write)? bank.wrReqs : bank.rdReqs;
 
     // Print bak queue? Use to verify FR-FCFS
@@ -435,7 +781,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 
     // No matches...
     if (!m) {
-        if (bank.open && req->loc.row == bank.openRow && bank.curRowHits < rowHitLimit && q.empty()) {
+        if (isRowHit(bank, req->loc, req->arrivalCycle) && bank.curRowHits < rowHitLimit && q.empty()) {
             // ... but row is open (& bank queue empty), bypass everyone
             /* NOTE: If the bank queue is not empty, don't go before the
              * current request. We assume that the request could have issued
@@ -455,12 +801,34 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
 #if 0
     printQ("POST");
 #endif
+
+    if (q.front() == req) updateHead(req->loc.rank, req->loc.bank, deferredWrites && req->write);
+}
+
+void DDRMemory::updateHead(uint32_t rank, uint32_t bank, bool wrQueue) {
+    HeadTracker& ht = headTrackers[wrQueue];
+    if (!ht.active) return;
+    uint32_t bankId = rank*banksPerRank + bank;
+    Request* head = bankHead(bankId, wrQueue);
+    ht.ready.remove(bankId);
+    if (head) ht.pending.set(bankId, findMinCmdCycle(*head));
+    else ht.pending.remove(bankId);
+}
+
+void DDRMemory::trackHeads(bool wrQueue) {
+    HeadTracker& ht = headTrackers[wrQueue];
+    assert(!ht.active && ht.pending.empty() && ht.ready.empty());
+    ht.active = true;
+    for (uint32_t bankId = 0; bankId < ranksPerChannel*banksPerRank; bankId++) {
+        Request* head = bankHead(bankId, wrQueue);
+        if (head) ht.pending.set(bankId, findMinCmdCycle(*head));
+    }
 }
 
 // For external ticks
 uint64_t DDRMemory::tick(uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
-    assert_msg(memCycle == nextSchedCycle, "%ld != %ld", memCycle, nextSchedCycle);
+    assert_msg(memCycle == nextSchedCycle || (fastMemClock && memCycle > nextSchedCycle), "%ld != %ld", memCycle, nextSchedCycle);
     uint64_t minSchedCycle = trySchedule(memCycle, sysCycle);
     assert(minSchedCycle >= memCycle);
     if (!rdQueue.full() && !wrQueue.full() && !overflowQueue.empty()) {
@@ -484,12 +852,15 @@ uint64_t DDRMemory::tick(uint64_t sysCycle) {
         }
     }
 
+    // Chunks of bulk transfers take freed-up queue slots after overflowed requests
+    minSchedCycle = std::min(minSchedCycle, feedBulkChunks(memCycle));
+
     nextSchedCycle = minSchedCycle;
     if (nextSchedCycle == -1ul) {
         nextSchedEvent = nullptr;
         return 0;
     } else {
-        // sysToMemCycle translates this back to nextSchedCycle
+        // sysToMemCycle translates this back to nextSchedCycle (or a later one, see fastMemClock)
         uint64_t enqSysCycle = std::max(matchingMemToSysCycle(nextSchedCycle), sysCycle);
         return enqSysCycle;
     }
@@ -503,9 +874,10 @@ void DDRMemory::recycleEvent(SchedEvent* ev) {
 }
 
 uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
-    const Bank& bank = banks[r.loc.rank][r.loc.bank];
-    uint64_t minCmdCycle = std::max(r.arrivalCycle, bank.lastCmdCycle + 1);
-    if (r.loc.row == bank.openRow && bank.open) {
+    const Bank& bank = banks[r.loc.rank*banksPerRank + r.loc.bank];
+    uint64_t readyCycle = std::max(r.arrivalCycle, r.pdExitCycle);
+    uint64_t minCmdCycle = std::max(readyCycle, bank.lastCmdCycle + 1);
+    if (isRowHit(bank, r.loc, r.arrivalCycle)) {
         // Row buffer hit
     } else {
         // Either row closed, or row buffer miss
@@ -513,13 +885,14 @@ uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
         if (!bank.open) {
             preCycle = bank.minPreCycle;
         } else {
-            assert(r.loc.row != bank.openRow);
-            preCycle = std::max(r.arrivalCycle, bank.minPreCycle);
+            preCycle = openBankPreCycle(bank, r.arrivalCycle);
         }
-        uint64_t actCycle = std::max(r.arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
+        uint64_t actCycle = std::max(readyCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minActCycle() + tFAW);
+        if (bankGroups > 1) actCycle = std::max(actCycle, minGroupActCycle(r.loc));
         minCmdCycle = actCycle + tRCD;
     }
+    if (bankGroups > 1) minCmdCycle = std::max(minCmdCycle, minGroupCasCycle(r.loc));
     return minCmdCycle;
 }
 
@@ -538,36 +911,124 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
      * order at *arrival* time, and we obey the appropriate timing constraints.
      */
 
-    if (rdQueue.empty() && wrQueue.empty()) return -1ul;
+    if (rdQueue.empty() && wrQueue.empty()) {
+        if (draining) {
+            draining = false;
+            profDrainCycles.inc(curCycle - drainStartCycle);
+        }
+        return -1ul;
+    }
     if (curCycle + tCL < minRespCycle) return minRespCycle - tCL;  // too far ahead
 
-    // Writes have priority if the write queue is getting full...
-    bool prioWrites = (wrQueue.size() > (3*queueDepth/4)) || (lastCmdWasWrite && wrQueue.size() > queueDepth/4);
+    // Writes have priority if the write queue is getting full, and keep it
+    // until it drops to the low watermark. Adaptive drains also start early
+    // when the data bus is idle, and yield to reads once enough of them wait.
+    bool prioWrites;
+    if (wrQueue.size() > wrHighWatermark) {
+        prioWrites = true;
+    } else if (wrQueue.size() <= wrLowWatermark) {
+        prioWrites = false;
+    } else if (!adaptiveDrain) {
+        prioWrites = lastCmdWasWrite;
+    } else {
+        bool busIdle = minRespCycle <= curCycle;
+        prioWrites = (lastCmdWasWrite || busIdle) && rdQueue.size() < drainReadLimit;
+    }
+    if (prioWrites != draining) {
+        if (prioWrites) {
+            drainStartCycle = curCycle;
+            profDrains.inc();
+        } else {
+            profDrainCycles.inc(curCycle - drainStartCycle);
+        }
+        draining = prioWrites;
+    }
     bool isWriteQueue = rdQueue.empty() || prioWrites;
 
     RequestQueue<Request>& queue = isWriteQueue? wrQueue : rdQueue;
     assert(!queue.empty());
 
+    /* FR-FCFS picks the oldest bank-queue head that can issue now (bank
+     * queues are already in FR order; bulk chunks may go after demand
+     * requests, see schedPrio()).
+     */
+    HeadTracker& ht = headTrackers[isWriteQueue];
+    if (!ht.active && queue.size() > SCAN_SCHED_DEPTH) {
+        trackHeads(isWriteQueue);
+    } else if (ht.active && queue.size() <= SCAN_SCHED_DEPTH/4) {
+        ht.pending.clear();
+        ht.ready.clear();
+        ht.active = false;
+    }
+
     Request* r = nullptr;
-    RequestQueue<Request>::iterator ir = queue.begin();
     uint64_t minSchedCycle = -1ul;
-    while (ir != queue.end()) {
-        //Bank& bank = banks[(*ir)->loc.rank][(*ir)->loc.bank];
-        //if ((isWriteQueue? bank.wrReqs : bank.rdReqs).front() == *ir) {
-        if (!(*ir)->prev) {  // FASTAH!
+    if (!ht.active) {
+        // Short queue: scan it in arrival (queueSeq) order
+        for (RequestQueue<Request>::iterator ir = queue.begin(); ir != queue.end(); ir.inc()) {
+            if ((*ir)->prev) continue;  // not first in its bank queue
             uint64_t minCmdCycle = findMinCmdCycle(**ir);
             minSchedCycle = std::min(minSchedCycle, minCmdCycle);
-            if (minCmdCycle <= curCycle) {
+            if (minCmdCycle <= curCycle && (!r || schedPrio(*ir) < schedPrio(r))) {
                 r = *ir;
+                if (schedPrio(r) == r->queueSeq) break;  // nothing later goes first
+            }
+        }
+        if (r) minSchedCycle = -1ul;
+    } else {
+        /* Heads whose lower bound has passed move to the ready heap, which we
+         * pop in priority order, checking the exact constraints; heads that
+         * are not actually ready go back to pending with their exact cycle.
+         */
+        while (!ht.pending.empty() && ht.pending.topKey() <= curCycle) {
+            uint32_t bankId = ht.pending.top();
+            ht.pending.remove(bankId);
+            ht.ready.set(bankId, schedPrio(bankHead(bankId, isWriteQueue)));
+        }
+
+        while (!ht.ready.empty()) {
+            uint32_t bankId = ht.ready.top();
+            Request* head = bankHead(bankId, isWriteQueue);
+            uint64_t minCmdCycle = findMinCmdCycle(*head);
+            if (minCmdCycle <= curCycle) {
+                r = head;
                 break;
             }
-            //DEBUG("Skipping 0x%lx, not ready %ld", (*ir)->ev->getAddr(), minCmdCycle);
-        } else {
-            //DEBUG("Skipping 0x%lx, not first", (*ir)->ev->getAddr());
+            ht.ready.remove(bankId);
+            ht.pending.set(bankId, minCmdCycle);
+        }
+
+        if (!r) {
+            // All heads are pending; tighten the smallest bound until it's exact
+            while (true) {
+                assert(!ht.pending.empty());
+                uint32_t bankId = ht.pending.top();
+                uint64_t minCmdCycle = findMinCmdCycle(*bankHead(bankId, isWriteQueue));
+                assert(minCmdCycle >= ht.pending.topKey());
+                if (minCmdCycle == ht.pending.topKey()) break;
+                ht.pending.set(bankId, minCmdCycle);
+            }
+            minSchedCycle = ht.pending.topKey();
+        }
+    }
+
+#if DDR_VALIDATE_SCHED
+    {
+        // Reference: linear scan over the queue in arrival order
+        Request* refReq = nullptr;
+        uint64_t refMinSchedCycle = -1ul;
+        for (RequestQueue<Request>::iterator ir = queue.begin(); ir != queue.end(); ir.inc()) {
+            if ((*ir)->prev) continue;  // not first in its bank queue
+            uint64_t minCmdCycle = findMinCmdCycle(**ir);
+            refMinSchedCycle = std::min(refMinSchedCycle, minCmdCycle);
+            if (minCmdCycle <= curCycle && (!refReq || schedPrio(*ir) < schedPrio(refReq))) refReq = *ir;
         }
-		//printf("ir=%ld\n", (uint64_t)&ir);
-        ir.inc();
+        assert_msg(refReq == r, "%s: scheduler picked %p, FR-FCFS scan picked %p", name.c_str(), r, refReq);
+        assert_msg(r || refMinSchedCycle == minSchedCycle, "%s: minSchedCycle %ld, FR-FCFS scan %ld",
+                name.c_str(), minSchedCycle, refMinSchedCycle);
     }
+#endif
+
     if (!r) {
         /* Because we have an event-driven model that uses the same timing
          * constraints to schedule a tick, this rarely happens. For example,
@@ -579,16 +1040,27 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
     DEBUG("%ld : Found ready request 0x%lx %s %ld (%ld / %ld)", curCycle, r->addr, r->write? "W" : "R", r->arrivalCycle, rdQueue.size(), wrQueue.size());
 
-    Bank& bank = banks[r->loc.rank][r->loc.bank];
+    Bank& bank = banks[r->loc.rank*banksPerRank + r->loc.bank];
 
     // Compute the minimum cycle at which the read or write command can be issued,
     // without column access or data bus constraints
     uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
-    if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
+    if (lastCmdWasWrite && !r->write) {
+        profWtrTurnarounds.inc();
+        if (minRespCycle + tWTR > minCmdCycle) {
+            profWtrCycles.inc(minRespCycle + tWTR - minCmdCycle);
+            minCmdCycle = minRespCycle + tWTR;
+        }
+    }
+    uint32_t bankId = r->loc.rank*banksPerRank + r->loc.bank;
+    bool sameRow = r->loc.row == bank.openRow;  // for the predictor: hit if the row had been left open
     bool rowHit = false;
-    if (r->loc.row == bank.openRow && bank.open) {
+    profClassReqs.inc(r->accClass);
+    if (isRowHit(bank, r->loc, r->arrivalCycle)) {
         // Row buffer hit
         rowHit = true;
+        profRowHits.inc(bankId);
+        profClassRowHits.inc(r->accClass);
     } else {
         // Either row closed, or row buffer miss
         uint64_t preCycle;
@@ -596,12 +1068,14 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         if (!bank.open) {
             preCycle = bank.minPreCycle;
         } else {
-            assert(r->loc.row != bank.openRow);
-            preCycle = std::max(r->arrivalCycle, bank.minPreCycle);
+            preCycle = openBankPreCycle(bank, r->arrivalCycle);
         }
+        if (bank.open && r->arrivalCycle < bank.closeCycle) profRowConflicts.inc(bankId);
+        else profRowEmpty.inc(bankId);
 
-        uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
+        uint64_t actCycle = std::max(std::max(r->arrivalCycle, r->pdExitCycle), std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
+        if (bankGroups > 1) actCycle = std::max(actCycle, minGroupActCycle(r->loc));
 
         // Record ACT
         bank.open = true;
@@ -609,35 +1083,73 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
         rankActWindows[r->loc.rank].addActivation(actCycle);
         bank.lastActCycle = actCycle;
+        profActs.inc();
+        if (bankGroups > 1) {
+            uint64_t& groupAct = groupLastActCycle[groupIdx(r->loc)];
+            groupAct = std::max(groupAct, actCycle);
+            rankLastActCycle[r->loc.rank] = std::max(rankLastActCycle[r->loc.rank], actCycle);
+        }
 
         minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
     }
 
+    if (bankGroups > 1) minCmdCycle = std::max(minCmdCycle, minGroupCasCycle(r->loc));
+
     // Figure out data bus constraints, find actual time at which command is issued
     uint64_t cmdCycle = std::max(minCmdCycle, minRespCycle - tCL);
 	// To support accessing granularity greater than a cacheline. 
     //minRespCycle = cmdCycle + tCL + tBL;
     //minRespCycle = cmdCycle + tCL + tBL * r->data_size;
-    minRespCycle = cmdCycle + tCL + r->data_size;
+    minRespCycle = cmdCycle + tCL + busCycles(r->data_size);
     lastCmdWasWrite = r->write;
+    if (r->write) {
+        assert(wrBufferedBursts >= r->data_size);
+        wrBufferedBursts -= r->data_size;
+        profWrBurstCycles.inc(busCycles(r->data_size));
+    } else {
+        profRdBurstCycles.inc(busCycles(r->data_size));
+    }
+    if (bankGroups > 1) {
+        groupLastCasCycle[groupIdx(r->loc)] = cmdCycle;
+        rankLastCasCycle[r->loc.rank] = cmdCycle;
+    }
 
     // Record PRE
-    // if closed-page, close (auto-precharge) if no more row buffer hits
-    // if open-page, minPreCycle is used for row buffer misses
-    if (closedPage && !(r->next && r->next->rowHitSeq != 0)) bank.open = false;
     bank.minPreCycle = std::max(
             bank.minPreCycle,  // for mixed read and write commands, minPreCycle may not be monotonic without this
             std::max(bank.lastActCycle + tRAS,  // RAS constraint
             r->write? minRespCycle + tWR : cmdCycle + tRTP  // read to precharge for reads, write recovery for writes
             ));
+    // if closed-page, close (auto-precharge) if no more row buffer hits
+    // if open-page, minPreCycle is used for row buffer misses
+    // if timeout, precharge after rowTimeout idle cycles
+    // if predict, close like closed-page unless the bank's predictor expects a
+    // row hit, then keep the row open (up to rowTimeout idle cycles, if set)
+    bool nextHit = r->next && r->next->rowHitSeq != 0;
+    bank.closeCycle = -1ul;
+    if (rowPolicy == ROW_PREDICT) {
+        if (sameRow) bank.rowPred = std::min(bank.rowPred + 1, 3);
+        else if (bank.rowPred) bank.rowPred--;
+    }
+    if (rowPolicy == ROW_CLOSED || (rowPolicy == ROW_PREDICT && bank.rowPred < 2)) {
+        if (!nextHit) bank.open = false;
+    } else if (rowPolicy != ROW_OPEN && rowTimeout) {
+        bank.closeCycle = std::max(bank.minPreCycle, cmdCycle + rowTimeout);
+    }
 
     // Record RD or WR
     assert(bank.lastCmdCycle < cmdCycle);
     bank.lastCmdCycle = cmdCycle;
     bank.curRowHits = r->rowHitSeq;
 
+    // Rank is busy until its data transfer ends
+    samplePower(r->loc.rank, cmdCycle);
+    rankPower[r->loc.rank].lastCmdCycle = std::max(rankPower[r->loc.rank].lastCmdCycle, minRespCycle);
+
     // Issue response
-    if (r->ev) {
+    if (r->bulk) {
+        finishBulkChunk(r, rowHit, sysCycle);
+    } else if (r->ev) {
         auto ev = r->ev;
         assert(!ev->isWrite() && !r->write);  // reads only
 
@@ -678,37 +1190,143 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
 
     // Dequeue this req
-    queue.remove(ir);
+    AddrLoc loc = r->loc;
+    queue.remove(r);
     (isWriteQueue? bank.wrReqs : bank.rdReqs).pop_front();
 
+    // Bank state changed, so both heads' constraints may have moved
+    updateHead(loc.rank, loc.bank, false);
+    updateHead(loc.rank, loc.bank, true);
+
     return (rdQueue.empty() && wrQueue.empty())? -1ul : minRespCycle - tCL;
 }
 
 void DDRMemory::refresh(uint64_t sysCycle) {
     uint64_t memCycle = sysToMemCycle(sysCycle);
+
+    if (tRFCpb) {
+        // Per-bank refresh: round-robin over banks, others stay available
+        uint32_t bankId = nextRefreshBank;
+        nextRefreshBank = (nextRefreshBank + 1) % (ranksPerChannel*banksPerRank);
+        Bank& bank = banks[bankId];
+        uint64_t minRefreshCycle = std::max(memCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
+        bank.minPreCycle = minRefreshCycle + tRFCpb - tRP;
+        bank.open = false;
+        updateHead(bankId / banksPerRank, bankId % banksPerRank, false);
+        updateHead(bankId / banksPerRank, bankId % banksPerRank, true);
+        profBankRefreshes.inc();
+        uint32_t rank = bankId / banksPerRank;
+        samplePower(rank, memCycle);
+        rankPower[rank].lastCmdCycle = std::max(rankPower[rank].lastCmdCycle, minRefreshCycle + tRFCpb);
+        DEBUG("Refresh bank %d %ld start %ld done %ld", bankId, memCycle, minRefreshCycle, minRefreshCycle + tRFCpb);
+        return;
+    }
     uint64_t minRefreshCycle = memCycle;
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
-            minRefreshCycle = std::max(minRefreshCycle, std::max(bank.minPreCycle, bank.lastCmdCycle));
-        }
+    for (uint32_t i = 0; i < ranksPerChannel*banksPerRank; i++) {
+        minRefreshCycle = std::max(minRefreshCycle, std::max(banks[i].minPreCycle, banks[i].lastCmdCycle));
     }
     assert(minRefreshCycle >= memCycle);
 
     uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
     assert(tRFC >= tRP);
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
-            // Close and force the ACT to happen at least at tRFC
-            // PRE <-tRP-> ACT, so discount tRP
-            bank.minPreCycle = refreshDoneCycle - tRP;
-            bank.open = false;
+    for (uint32_t i = 0; i < ranksPerChannel*banksPerRank; i++) {
+        // Close and force the ACT to happen at least at tRFC
+        // PRE <-tRP-> ACT, so discount tRP
+        banks[i].minPreCycle = refreshDoneCycle - tRP;
+        banks[i].open = false;
+    }
+    for (uint32_t rank = 0; rank < ranksPerChannel; rank++) {
+        for (uint32_t b = 0; b < banksPerRank; b++) {
+            updateHead(rank, b, false);
+            updateHead(rank, b, true);
         }
+        samplePower(rank, memCycle);
+        rankPower[rank].lastCmdCycle = std::max(rankPower[rank].lastCmdCycle, refreshDoneCycle);
     }
+    profRefreshes.inc(ranksPerChannel);
 
     DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
 }
 
 
+/* Power and energy accounting */
+
+void DDRMemory::idleCycles(uint32_t rank, uint64_t memCycle, uint64_t& stbyCycles, uint64_t& pdCycles) const {
+    const RankPowerState& rp = rankPower[rank];
+    if (memCycle <= rp.lastSampleCycle) {
+        stbyCycles = pdCycles = 0;
+        return;
+    }
+    uint64_t pdStart = memCycle;
+    if (powerDownIdle) pdStart = std::max(rp.lastSampleCycle, std::min(memCycle, rp.lastCmdCycle + powerDownIdle));
+    stbyCycles = pdStart - rp.lastSampleCycle;
+    pdCycles = memCycle - pdStart;
+}
+
+void DDRMemory::samplePower(uint32_t rank, uint64_t memCycle) {
+    RankPowerState& rp = rankPower[rank];
+    uint64_t stbyCycles, pdCycles;
+    idleCycles(rank, memCycle, stbyCycles, pdCycles);
+    (rp.rowsOpen? profActStbyCycles : profPreStbyCycles).inc(stbyCycles);
+    (rp.rowsOpen? profActPdCycles : profPrePdCycles).inc(pdCycles);
+    if (pdCycles) profPdExits.inc();  // we only sample on activity
+    rp.lastSampleCycle = std::max(rp.lastSampleCycle, memCycle);
+
+    bool rowsOpen = false;
+    for (uint32_t b = 0; b < banksPerRank; b++) {
+        const Bank& bank = banks[rank*banksPerRank + b];
+        rowsOpen |= bank.open && rp.lastSampleCycle < bank.closeCycle;
+    }
+    rp.rowsOpen = rowsOpen;
+}
+
+double DDRMemory::actEnergy() const {
+    // IDD0 covers a full ACT-PRE cycle; subtract the background current it includes
+    double perAct = (double)IDD0*(tRAS + tRP) - (double)IDD3N*tRAS - (double)IDD2N*tRP;
+    return energyPJ(perAct*profActs.get());
+}
+
+double DDRMemory::rdEnergy() const {
+    return energyPJ(((double)IDD4R - IDD3N)*profRdBurstCycles.get());
+}
+
+double DDRMemory::wrEnergy() const {
+    return energyPJ(((double)IDD4W - IDD3N)*profWrBurstCycles.get());
+}
+
+double DDRMemory::refEnergy() const {
+    // A per-bank refresh does 1/banksPerRank of the work of an all-bank one
+    double refs = profRefreshes.get() + (double)profBankRefreshes.get()/banksPerRank;
+    return energyPJ(((double)IDD5 - IDD3N)*tRFC*refs);
+}
+
+double DDRMemory::bgEnergy() const {
+    double actStby = profActStbyCycles.get(), preStby = profPreStbyCycles.get();
+    double actPd = profActPdCycles.get(), prePd = profPrePdCycles.get();
+    // Add the time since each rank was last sampled, in its last known state
+    uint64_t curCycle = curMemCycle();
+    for (uint32_t rank = 0; rank < ranksPerChannel; rank++) {
+        uint64_t stbyCycles, pdCycles;
+        idleCycles(rank, curCycle, stbyCycles, pdCycles);
+        (rankPower[rank].rowsOpen? actStby : preStby) += stbyCycles;
+        (rankPower[rank].rowsOpen? actPd : prePd) += pdCycles;
+    }
+    return energyPJ(IDD3N*actStby + IDD2N*preStby + IDD3P*actPd + IDD2P*prePd);
+}
+
+double DDRMemory::getEnergy() const {
+    return actEnergy() + rdEnergy() + wrEnergy() + refEnergy() + bgEnergy();
+}
+
+uint64_t DDRMemory::curMemCycle() const {
+    return zinfo->globPhaseCycles*memFreqKHz/sysFreqKHz;
+}
+
+double DDRMemory::getElapsedNs() const {
+    return curMemCycle()*tCKns;
+}
+
+
 /* Tech/Device timing parameters */
 
 void DDRMemory::initTech(const char* techName, double time_scale) {
@@ -717,22 +1335,128 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
 
     // tBL's below are for 64-byte lines; we adjust as needed
 
+    // Defaults for techs without bank groups or per-bank refresh, on a 64-bit bus
+    bankGroups = 1;
+    tCCD_S = tCCD_L = tRRD_S = tRRD_L = 0;
+    tRFCpb = 0;
+    busBytesPerCycle = 2*JEDEC_BUS_WIDTH/8;
+
     // Please keep this orderly; go from faster to slower technologies
-    if (tech == "DDR3-1333-CL10") {
+    if (tech == "HBM2-2000" || tech == "HBM2-2000-PC") {
+        // HBM2 at 2Gbps/pin, 8Gb dies, 16 banks in 4 bank groups per (pseudo-)channel
+        // Approximate, from public HBM2 datasheets (SK Hynix, Samsung)
+        // Legacy mode: 128-bit channel, BL2 (64B in 2 tCK)
+        // Pseudo-channel mode (-PC): each model is one of the 2 64-bit
+        // pseudo-channels of a channel, BL4 (64B in 4 tCK); pseudo-channels
+        // share the command bus, which we do not model
+        bool pc = (tech == "HBM2-2000-PC");
+        tCK = 1.0;
+        tBL = pc? 4 : 2;
+        busBytesPerCycle = pc? 16 : 32;
+        tCL = 14;
+        tRCD = 14;
+        tRTP = 4;
+        tRP = 14;
+        tRRD = 4;
+        tRAS = 33;
+        tFAW = 16;
+        tWTR = 8;
+        tWR = 16;
+        tRFC = 350;
+        tREFI = 3900;
+        tRFCpb = 160;
+        bankGroups = 4;
+        tCCD_S = pc? 2 : 1;
+        tCCD_L = pc? 4 : 2;
+        tRRD_S = 4;
+        tRRD_L = 6;
+        // Power: one die per channel, VDD 1.2V
+        VDD = 1.2; devicesPerRank = 1; tXP = 8;
+        IDD0 = 50; IDD2P = 10; IDD2N = 25; IDD3P = 20; IDD3N = 35; IDD4R = 270; IDD4W = 250; IDD5 = 230;
+    } else if (tech == "DDR4-3200-CL22") {
+        // JEDEC DDR4-3200AA (22-22-22), 8Gb x8 devices (1KB page), 4 bank groups x 4 banks
+        tCK = 0.625;
+        tBL = 4;
+        tCL = 22;
+        tRCD = 22;
+        tRTP = 12;
+        tRP = 22;
+        tRRD = 4;
+        tRAS = 52;
+        tFAW = 34;
+        tWTR = 12;  // tWTR_L
+        tWR = 24;
+        tRFC = 560;
+        tREFI = 12480;
+        bankGroups = 4;
+        tCCD_S = 4;
+        tCCD_L = 8;
+        tRRD_S = 4;
+        tRRD_L = 8;
+        // Power: Micron 8Gb x8 DDR4-3200, 8 devices on a 64-bit rank
+        VDD = 1.2; devicesPerRank = 8; tXP = 10;
+        IDD0 = 60; IDD2P = 25; IDD2N = 34; IDD3P = 34; IDD3N = 43; IDD4R = 168; IDD4W = 150; IDD5 = 250;
+    } else if (tech == "DDR4-2400-CL17") {
+        // JEDEC DDR4-2400R (17-17-17), 8Gb x8 devices (1KB page), 4 bank groups x 4 banks
+        tCK = 0.833;
+        tBL = 4;
+        tCL = 17;
+        tRCD = 17;
+        tRTP = 9;
+        tRP = 17;
+        tRRD = 4;
+        tRAS = 39;
+        tFAW = 26;
+        tWTR = 9;  // tWTR_L
+        tWR = 18;
+        tRFC = 420;
+        tREFI = 9360;
+        bankGroups = 4;
+        tCCD_S = 4;
+        tCCD_L = 6;
+        tRRD_S = 4;
+        tRRD_L = 6;
+        // Power: Micron 8Gb x8 DDR4-2400, 8 devices on a 64-bit rank
+        VDD = 1.2; devicesPerRank = 8; tXP = 8;
+        IDD0 = 55; IDD2P = 25; IDD2N = 34; IDD3P = 34; IDD3N = 43; IDD4R = 135; IDD4W = 130; IDD5 = 250;
+    } else if (tech == "LPDDR4-3200") {
+        // JEDEC LPDDR4-3200, 8Gb die, one x16 channel with 8 banks, BL16 (64B in 16 tCK)
+        tCK = 0.625;
+        tBL = 16;
+        busBytesPerCycle = 4;
+        tCL = 28;
+        tRCD = 29;
+        tRTP = 12;
+        tRP = 29;
+        tRRD = 16;
+        tRAS = 68;
+        tFAW = 64;
+        tWTR = 16;
+        tWR = 29;
+        tRFC = 448;
+        tREFI = 6240;
+        tRFCpb = 224;
+        // Power: VDD2 rail only (it dominates), one die
+        VDD = 1.1; devicesPerRank = 1; tXP = 12;
+        IDD0 = 58; IDD2P = 2; IDD2N = 20; IDD3P = 8; IDD3N = 26; IDD4R = 250; IDD4W = 230; IDD5 = 150;
+    } else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
         tCK = 1.5 / 2;  // ns; all other in mem cycles
         tBL = 4;
-        tCL = uint32_t(10 / time_scale);
-        tRCD = uint32_t( 10 / time_scale);
-        tRTP = uint32_t( 5 / time_scale);
-        tRP = uint32_t( 10 / time_scale);
-        tRRD = uint32_t( 4 / time_scale);
-        tRAS = uint32_t( 24 / time_scale);
-        tFAW = uint32_t( 20 / time_scale);
-        tWTR = uint32_t( 5 / time_scale);
-        tWR = uint32_t( 10 / time_scale);
-        tRFC = uint32_t( 74 / time_scale);
-        tREFI = uint32_t( 5200 / time_scale);
+        tCL = 10;
+        tRCD = 10;
+        tRTP = 5;
+        tRP = 10;
+        tRRD = 4;
+        tRAS = 24;
+        tFAW = 20;
+        tWTR = 5;
+        tWR = 10;
+        tRFC = 74;
+        tREFI = 5200;
+        // Power: same file, 16 x4 devices on a 64-bit rank
+        VDD = 1.5; devicesPerRank = 16; tXP = 4;
+        IDD0 = 100; IDD2P = 10; IDD2N = 70; IDD3P = 60; IDD3N = 90; IDD4R = 230; IDD4W = 255; IDD5 = 305;
     } else if (tech == "DDR3-1066-CL7") {
         // from DDR3_micron_16M_8B_x4_sg187.ini
         // see http://download.micron.com/pdf/datasheets/dram/ddr3/1Gb_DDR3_SDRAM.pdf, cl7 variant, copied from it; tRRD is widely different, others match
@@ -749,6 +1473,9 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = 7;
         tRFC = 59;
         tREFI = 4160;
+        // Power: Micron 1Gb x4 DDR3-1066, 16 devices on a 64-bit rank
+        VDD = 1.5; devicesPerRank = 16; tXP = 4;
+        IDD0 = 90; IDD2P = 10; IDD2N = 65; IDD3P = 55; IDD3N = 80; IDD4R = 190; IDD4W = 205; IDD5 = 260;
     } else if (tech == "DDR3-1066-CL8") {
         // from DDR3_micron_16M_8B_x4_sg187.ini
         tCK = 1.875;
@@ -764,13 +1491,30 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
         tWR = 8;
         tRFC = 59;
         tREFI = 4160;
+        // Power: Micron 1Gb x4 DDR3-1066, 16 devices on a 64-bit rank
+        VDD = 1.5; devicesPerRank = 16; tXP = 4;
+        IDD0 = 90; IDD2P = 10; IDD2N = 65; IDD3P = 55; IDD3N = 80; IDD4R = 190; IDD4W = 205; IDD5 = 260;
     } else {
         panic("Unknown technology %s, you'll need to define it", techName);
     }
 
+    // time_scale (sys.mem.dram_timing_scale) speeds up (> 1) or slows down (< 1)
+    // every timing constraint of the tech, but not its clock or data transfers
+    if (time_scale <= 0.0) panic("%s: timing scale must be positive, it is %f", name.c_str(), time_scale);
+    if (time_scale != 1.0) {
+        uint32_t* timings[] = {&tCL, &tRCD, &tRTP, &tRP, &tRRD, &tRAS, &tFAW, &tWTR, &tWR, &tRFC, &tREFI, &tRFCpb,
+                &tCCD_S, &tCCD_L, &tRRD_S, &tRRD_L, &tXP};
+        for (uint32_t* t : timings) *t = uint32_t(*t / time_scale);
+    }
+
     // Check all params were set
     assert(tCK > 0.0);
     assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI);
+    assert(bankGroups == 1 || (tCCD_S && tCCD_L && tRRD_S && tRRD_L));
+    assert(!tRFCpb || tRFCpb >= tRP);
+    assert(VDD > 0.0 && devicesPerRank && tXP);
+    assert(IDD2P <= IDD2N && IDD3P <= IDD3N && IDD2N <= IDD3N);
+    assert(IDD4R >= IDD3N && IDD4W >= IDD3N && IDD5 >= IDD3N);
 
     if (isPow2(lineSize) && lineSize >= 64) {
         tBL = lineSize*tBL/64;
@@ -783,5 +1527,6 @@ void DDRMemory::initTech(const char* techName, double time_scale) {
     }
 
     memFreqKHz = (uint64_t)(1e9/tCK/1e3);
+    tCKns = tCK;
 }
 
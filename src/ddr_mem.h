@@ -26,14 +26,21 @@
 #ifndef DDR_MEM_H_
 #define DDR_MEM_H_
 
-#include <deque>
-
+#include <string>
+#include "g_std/g_deque.h"
 #include "g_std/g_string.h"
+#include "host_placement.h"
 #include "intrusive_list.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
 #include "stats.h"
 
+/* Set to 1 to check every scheduling decision against a linear FR-FCFS scan
+ * of the request queue (slow; debug builds enable it).
+ */
+#ifndef DDR_VALIDATE_SCHED
+#define DDR_VALIDATE_SCHED 0
+#endif
 
 /* Helper data structures */
 
@@ -78,6 +85,99 @@ class ActWindow {
         inline uint32_t dec(uint32_t i) const { return i? i-1 : buf.size()-1; }
 };
 
+/* Indexed binary min-heap over a fixed set of ids (banks), with O(log n)
+ * insert, remove and key updates in either direction
+ */
+class IdHeap {
+    private:
+        uint64_t* keys;  // indexed by id
+        uint32_t* heap;  // ids
+        uint32_t* pos;   // indexed by id, -1u if not in the heap
+        uint32_t size;
+        uint32_t numIds;
+
+    public:
+        void init(uint32_t _numIds) {
+            numIds = _numIds;
+            // keys, heap and pos share one block, on pages of its own
+            keys = gm_page_alloc<uint64_t>(2*numIds);
+            heap = reinterpret_cast<uint32_t*>(keys + numIds);
+            pos = heap + numIds;
+            for (uint32_t i = 0; i < numIds; i++) pos[i] = -1u;
+            size = 0;
+        }
+
+        inline const void* storage() const { return keys; }
+        inline size_t storageBytes() const { return hostPageBytes(2*numIds*sizeof(uint64_t)); }
+
+        inline bool empty() const { return !size; }
+        inline bool contains(uint32_t id) const { return pos[id] != -1u; }
+        inline uint32_t top() const { return heap[0]; }
+        inline uint64_t topKey() const { return keys[heap[0]]; }
+
+        // Insert or change the key of id
+        inline void set(uint32_t id, uint64_t key) {
+            if (!contains(id)) {
+                keys[id] = key;
+                heap[size] = id;
+                siftUp(size++);
+            } else if (key < keys[id]) {
+                keys[id] = key;
+                siftUp(pos[id]);
+            } else {
+                keys[id] = key;
+                siftDown(pos[id]);
+            }
+        }
+
+        inline void clear() {
+            for (uint32_t i = 0; i < size; i++) pos[heap[i]] = -1u;
+            size = 0;
+        }
+
+        inline void remove(uint32_t id) {
+            if (!contains(id)) return;
+            uint32_t p = pos[id];
+            uint32_t last = heap[--size];
+            pos[id] = -1u;
+            if (last != id) {
+                heap[p] = last;
+                siftUp(p);
+                siftDown(pos[last]);
+            }
+        }
+
+    private:
+        inline void place(uint32_t p, uint32_t id) {
+            heap[p] = id;
+            pos[id] = p;
+        }
+
+        void siftUp(uint32_t p) {
+            uint32_t id = heap[p];
+            while (p) {
+                uint32_t parent = (p - 1)/2;
+                if (keys[heap[parent]] <= keys[id]) break;
+                place(p, heap[parent]);
+                p = parent;
+            }
+            place(p, id);
+        }
+
+        void siftDown(uint32_t p) {
+            uint32_t id = heap[p];
+            while (true) {
+                uint32_t c = 2*p + 1;
+                if (c >= size) break;
+                if (c + 1 < size && keys[heap[c+1]] < keys[heap[c]]) c++;
+                if (keys[id] <= keys[heap[c]]) break;
+                place(p, heap[c]);
+                p = c;
+            }
+            place(p, id);
+        }
+};
+
 // Read or write queues, ordered/inserted by arrival time, out-of-order finish
 template <typename T>
 class RequestQueue {
@@ -87,17 +187,25 @@ class RequestQueue {
         };
         InList<Node> reqList;  // FIFO
         InList<Node> freeList; // LIFO (higher locality)
+        size_t elemOffset;     // offset of elem in Node, to go from T* to Node*
+        Node* buf;             // on pages of its own
+        size_t bufSize;
 
     public:
         void init(size_t size) {
             assert(reqList.empty() && freeList.empty());
-            Node* buf = gm_calloc<Node>(size);
+            buf = gm_page_alloc<Node>(size);
+            bufSize = size;
             for (uint32_t i = 0; i < size; i++) {
                 new (&buf[i]) Node();
                 freeList.push_back(&buf[i]);
             }
+            elemOffset = (char*)&buf[0].elem - (char*)&buf[0];
         }
 
+        inline const void* storage() const { return buf; }
+        inline size_t storageBytes() const { return hostPageBytes(bufSize*sizeof(Node)); }
+
         inline bool empty() const { return reqList.empty(); }
         inline bool full() const { return freeList.empty(); }
         inline size_t size() const { return reqList.size(); }
@@ -127,9 +235,15 @@ class RequestQueue {
             reqList.remove(i.n);
             freeList.push_back(i.n);
         }
+
+        inline void remove(T* elem) {
+            remove(iterator((Node*)((char*)elem - elemOffset)));
+        }
 };
 
+class Config;
 class DDRMemoryAccEvent;
+struct DDRMemoryConfig;
 class SchedEvent;
 
 // Single-channel controller. For multiple channels, use multiple controllers.
@@ -143,6 +257,8 @@ class DDRMemory : public MemObject {
             uint32_t col;
         };
 
+        struct BulkTransfer;
+
         struct Request : InListNode<Request> {
             Address addr;
             AddrLoc loc;
@@ -150,14 +266,40 @@ class DDRMemory : public MemObject {
 			uint32_t data_size; // access data size. 1 for cacheline, 64 for page
 
             uint64_t rowHitSeq; // sequence number used to throttle max # row hits
+            uint64_t queueSeq;  // position in arrival order, for FCFS among bank heads
 
             // Cycle accounting
             uint64_t arrivalCycle;  // in memCycles
             uint64_t startSysCycle;  // in sysCycles
+            uint64_t pdExitCycle;  // if the rank was powered down at arrival, when it can take commands (arrival + tXP); else 0
+            uint8_t accClass;  // AccessClass
 
             // Corresponding event to send a response to
             // Writes get a response immediately, so this is nullptr for them
             DDRMemoryAccEvent* ev;
+
+            // If this is a chunk of a bulk transfer, the transfer; else nullptr
+            BulkTransfer* bulk;
+        };
+
+        /* Large transfers (page fills and writebacks) are split into chunks,
+         * each covering the lines of the transfer that fall in the same
+         * rank, bank and row (i.e., differ only in their col bits), up to
+         * bulkChunkBursts. Chunks are fed into the request queues as
+         * earlier ones finish, at most bulkMaxChunks at a time, so demand
+         * requests can interleave with them.
+         */
+        struct BulkTransfer : InListNode<BulkTransfer>, GlobAlloc {
+            DDRMemoryAccEvent* ev;  // reads: responded to when the last chunk finishes
+            Address startLine, endLine;  // [startLine, endLine)
+            Address scanLine;   // next line to consider as the start of a new chunk group
+            Address groupLine;  // next line of the current group, if inGroup
+            bool inGroup;
+            bool write;
+            uint64_t linesLeft, burstsLeft;  // not yet split into chunks
+            uint32_t chunksInFlight;
+            uint64_t startSysCycle;
+            uint8_t accClass;
         };
 
         struct Bank {
@@ -170,6 +312,8 @@ class DDRMemory : public MemObject {
             uint64_t lastCmdCycle;  // RD/WR command, used for refreshes only
 
             uint64_t curRowHits;    // row hits on the currently opened row
+            uint64_t closeCycle;    // if open, cycle the row is precharged unless a request for it arrives first
+            uint8_t rowPred;        // 2-bit saturating counter, >= 2 predicts the next access hits the open row
 
             InList<Request> rdReqs;
             InList<Request> wrReqs;
@@ -193,8 +337,42 @@ class DDRMemory : public MemObject {
         const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
         const bool deferredWrites;
         const bool closedPage;
+
+        // Row buffer management, see setRowPolicy()
+    public:
+        enum RowPolicy {ROW_CLOSED, ROW_OPEN, ROW_TIMEOUT, ROW_PREDICT};
+
+        // Who issued a request, from its MemReq::DRAMCACHE_* flags, for per-class row buffer stats
+        enum AccessClass {ACC_OTHER, ACC_TAG, ACC_DATA, ACC_FILL, ACC_EVICT, ACC_COUNTER, NUM_ACC_CLASSES};
+        static AccessClass accessClass(const MemReq& req) {
+            if (req.is(MemReq::DRAMCACHE_TAG)) return ACC_TAG;
+            if (req.is(MemReq::DRAMCACHE_DATA)) return ACC_DATA;
+            if (req.is(MemReq::DRAMCACHE_FILL)) return ACC_FILL;
+            if (req.is(MemReq::DRAMCACHE_EVICT)) return ACC_EVICT;
+            if (req.is(MemReq::DRAMCACHE_COUNTER)) return ACC_COUNTER;
+            return ACC_OTHER;
+        }
+    private:
+        RowPolicy rowPolicy;
+        uint32_t rowTimeout;  // idle memory cycles before an open row is precharged (ROW_TIMEOUT, ROW_PREDICT)
         const uint32_t domain;
 
+        // Bulk transfer policy, see setBulkPolicy()
+        uint32_t bulkChunkBursts;  // 0 disables splitting
+        uint32_t bulkMaxChunks;
+        bool bulkDemandFirst;
+
+        // Write drain policy, see setWritePolicy()
+        uint32_t wrHighWatermark;  // drain writes above this write queue occupancy...
+        uint32_t wrLowWatermark;   // ... until they drop to this one
+        bool adaptiveDrain;
+        uint32_t drainReadLimit;   // adaptive drains yield to reads once this many wait
+        uint64_t writeBufferBursts;  // capacity for accepted but unissued writes; 0 is unbounded
+        uint64_t wrBufferedBursts;   // accepted but unissued writes (weave phase)
+        uint64_t wrPostedDrainCycle; // memory cycle by which all writes posted so far can drain (bound phase)
+        bool draining;
+        uint64_t drainStartCycle;
+
         // DRAM timing parameters -- initialized in initTech()
         // All parameters are in memory clocks (multiples of tCK)
         uint32_t tBL;    // burst length (== tTrans)
@@ -209,23 +387,90 @@ class DDRMemory : public MemObject {
         uint32_t tWR;    // end of WR burst to PRE
         uint32_t tRFC;   // Refresh to ACT (refresh leaves rows closed)
         uint32_t tREFI;  // Refresh interval
+        uint32_t tRFCpb; // Per-bank refresh to ACT; if set, we refresh one bank every tREFI/banks
+
+        // Bank groups (DDR4, HBM2); with bankGroups == 1, these are not modeled
+        uint32_t bankGroups;
+        uint32_t tCCD_S, tCCD_L;  // CAS to CAS, different / same bank group
+        uint32_t tRRD_S, tRRD_L;  // ACT to ACT, different / same bank group
+
+        uint32_t busBytesPerCycle;  // data bus bytes per tCK, 2x bus width for DDR
+
+        // DRAM power parameters -- initialized in initTech()
+        // Currents are per device, in mA, as in datasheets (IDDx)
+        double tCKns;  // ns
+        double VDD;    // V
+        uint32_t devicesPerRank;
+        uint32_t IDD0;   // ACT-PRE cycling
+        uint32_t IDD2P;  // precharge power-down
+        uint32_t IDD2N;  // precharge standby
+        uint32_t IDD3P;  // active power-down
+        uint32_t IDD3N;  // active standby
+        uint32_t IDD4R, IDD4W;  // read, write bursts
+        uint32_t IDD5;   // refresh
+        uint32_t tXP;    // power-down exit to any command
+        uint32_t powerDownIdle;  // idle mem cycles before a rank powers down; 0 disables power-down
+
+        /* Background power state of each rank, integrated lazily: the time
+         * since lastSampleCycle is accounted as standby until powerDownIdle
+         * cycles past lastCmdCycle, and power-down after that. Sampled when the
+         * rank issues a command or is refreshed, so the standby/power-down split
+         * is never off by more than a refresh interval.
+         */
+        struct RankPowerState {
+            uint64_t lastSampleCycle;
+            uint64_t lastCmdCycle;
+            bool rowsOpen;  // as of lastSampleCycle
+        };
+        g_vector<RankPowerState> rankPower;
 
         // Address mapping information
         uint32_t colShift, colMask;
         uint32_t rankShift, rankMask;
         uint32_t bankShift, bankMask;
         uint64_t rowShift;  // row's always top
+        bool bankXorHash;  // XOR bank bits with the low row bits, see mapLineAddr()
 
         uint32_t minRdLatency;
         uint32_t minWrLatency;
         uint32_t preDelay, postDelayRd, postDelayWr;
 
         RequestQueue<Request> rdQueue, wrQueue;
-        std::deque<Request> overflowQueue;
+        g_deque<Request> overflowQueue;
 
-        g_vector< g_vector<Bank> > banks; // indexed by rank, bank
+        Bank* banks;  // indexed by bank id, rank*banksPerRank + bank; on pages of their own
         g_vector<ActWindow> rankActWindows;
 
+        // Bank group constraints: last ACT and RD/WR per rank, and per bank
+        // group (indexed by rank*bankGroups + group)
+        g_vector<uint64_t> rankLastActCycle, rankLastCasCycle;
+        g_vector<uint64_t> groupLastActCycle, groupLastCasCycle;
+
+        uint32_t nextRefreshBank;  // per-bank refresh, rank*banksPerRank + bank
+
+        /* Per-queue (read, write) tracking of bank-queue heads, so that
+         * trySchedule does not walk the whole request queue. Short queues are
+         * cheaper to scan, so heads are only tracked (active) while the queue
+         * holds more than SCAN_SCHED_DEPTH requests, and until it empties.
+         * While active, each bank with a non-empty queue is in exactly one heap:
+         *  - pending, keyed by a lower bound on findMinCmdCycle() of its head.
+         *    Bounds are exact when the bank's state or head change; ACTs from
+         *    other banks in the rank can only raise the true value (tFAW).
+         *  - ready, keyed by queueSeq: lower bound has passed, may issue.
+         */
+        struct HeadTracker {
+            IdHeap pending;
+            IdHeap ready;
+            bool active;
+        };
+        static const uint32_t SCAN_SCHED_DEPTH = 32;
+        HeadTracker headTrackers[2];  // indexed by isWriteQueue
+        uint64_t nextQueueSeq;
+
+        InList<BulkTransfer> bulkTransfers;  // not fully split yet, FIFO
+        InList<BulkTransfer> bulkFreelist;
+        uint32_t bulkChunksInFlight;
+
         // Event scheduling
         SchedEvent* nextSchedEvent;
         uint64_t nextSchedCycle;
@@ -239,6 +484,15 @@ class DDRMemory : public MemObject {
 		Counter bytesReads, bytesWrites;
         Counter profTotalRdLat, profTotalWrLat;
         Counter profReadHits, profWriteHits;  // row buffer hits
+        Counter profBulkXfers, profBulkChunks, profBulkHits;
+        Counter profDrains, profDrainCycles;
+        Counter profWtrTurnarounds, profWtrCycles;
+        VectorCounter profRowHits, profRowConflicts, profRowEmpty;  // per bank, rank*banksPerRank + bank
+        Counter profActs, profRdBurstCycles, profWrBurstCycles;
+        Counter profRefreshes, profBankRefreshes;  // per rank, all-bank; per bank
+        Counter profActStbyCycles, profPreStbyCycles, profActPdCycles, profPrePdCycles;  // summed over ranks
+        Counter profPdExits;
+        VectorCounter profClassReqs, profClassRowHits;  // per AccessClass
         VectorCounter latencyHist;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
         PAD();
@@ -246,28 +500,62 @@ class DDRMemory : public MemObject {
         //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
         //uint64_t cycles by this; as it is, KHzs are 20 bits, so we can simulate ~40+ bits (a few trillion system cycles, around an hour))
         uint64_t sysFreqKHz, memFreqKHz;
+        bool fastMemClock;  // memFreq >= sysFreq/2, so ticks may run a few memory cycles late
 
         // sys<->mem cycle xlat functions. We get and must return system cycles, but all internal logic is in memory cycles
         // will do the right thing so long as you multiply first
         inline uint64_t sysToMemCycle(uint64_t sysCycle) { return sysCycle*memFreqKHz/sysFreqKHz+1; }
         inline uint64_t memToSysCycle(uint64_t memCycle) { return (memCycle+1)*sysFreqKHz/memFreqKHz; }
 
-        // Produces a sysCycle that, when translated back using sysToMemCycle, will produce the same memCycle
-        // Requires memFreq < sysFreq/2
+        // Produces a sysCycle that, when translated back using sysToMemCycle, will produce the same memCycle.
+        // If memFreq >= sysFreq/2, some memCycles have no such sysCycle, so this produces the first sysCycle
+        // that translates to memCycle or later
         inline uint64_t matchingMemToSysCycle(uint64_t memCycle) {
             // The -sysFreqKHz/memFreqKHz/2 cancels the +1 in sysToMemCycle in integer arithmetic --- you can prove this with inequalities
-            return (2*memCycle-1)*sysFreqKHz/memFreqKHz/2;
+            if (!fastMemClock) return (2*memCycle-1)*sysFreqKHz/memFreqKHz/2;
+            return ((memCycle-1)*sysFreqKHz + memFreqKHz - 1)/memFreqKHz;
         }
 
     public:
         DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
             uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
             uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-            uint32_t _domain, g_string& _name, uint32_t _tBL = 4, double time_scale = 1.0);
+            uint32_t _domain, g_string& _name, uint32_t _tBL = 0 /*from tech*/, double time_scale = 1.0);
 
         void initStats(AggregateStat* parentStat);
         const char* getName() {return name.c_str();}
 
+        /* Binds this object and its per-bank and queue arrays to the host node
+         * that simulates our domain. The object must come from gm_page_alloc.
+         */
+        void placeOnDomainNode();
+
+        /* Split transfers larger than chunkBursts into row-sized chunks, with
+         * up to maxChunks of them queued at once. If demandFirst, ready demand
+         * requests are always scheduled before ready chunks; otherwise chunks
+         * compete in plain FR-FCFS order. chunkBursts == 0 issues each
+         * transfer as a single command that holds the bus for its whole size.
+         */
+        void setBulkPolicy(uint32_t chunkBursts, uint32_t maxChunks, bool demandFirst);
+        // Applies the policy options of cfg; the rest are constructor args
+        void setPolicies(const DDRMemoryConfig& cfg);
+        void setBankXorHash(bool enable) { bankXorHash = enable; }
+        void setRowPolicy(RowPolicy policy, uint32_t timeout);
+        void setWritePolicy(uint32_t highWatermark, uint32_t lowWatermark, bool adaptive, uint32_t readLimit, uint32_t bufferLines);
+        // Power down ranks idle for idleCycles memory cycles (0 disables);
+        // their next command pays tXP
+        void setPowerDown(uint32_t idleCycles) { powerDownIdle = idleCycles; }
+
+        // DRAM energy so far, in pJ, and the elapsed time it covers, in ns
+        double getEnergy() const;
+        double getElapsedNs() const;
+
+        // Bound phase backpressure: cycle at which a write of data_size
+        // bursts issued at sysCycle is accepted, later than sysCycle if the
+        // write buffer is full. Called once per posted write, which must then
+        // be issued at the returned cycle
+        uint64_t writeAcceptCycle(Address lineAddr, uint64_t sysCycle, uint32_t data_size);
+
         // Bound phase interface
 		// data_size is the number of bursts with burst length = 16 bytes.
 		// A cacheline takes 4 bursts
@@ -286,12 +574,104 @@ class DDRMemory : public MemObject {
         AddrLoc mapLineAddr(Address lineAddr);
 
         void queue(Request* req, uint64_t memCycle);
+        void scheduleTick(uint64_t minSchedCycle, uint64_t sysCycle);
+
+        void startBulk(DDRMemoryAccEvent* ev, uint64_t memCycle, uint64_t sysCycle);
+        uint64_t feedBulkChunks(uint64_t memCycle);
+        void splitBulkChunk(BulkTransfer* bt, Request* req);
+        void finishBulkChunk(Request* r, bool rowHit, uint64_t sysCycle);
+
+        // Ready-heap key: FCFS, with chunks after demand requests if bulkDemandFirst
+        inline uint64_t schedPrio(const Request* r) const {
+            return (bulkDemandFirst && r->bulk)? (r->queueSeq | (1ul << 63)) : r->queueSeq;
+        }
 
         inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
         uint64_t findMinCmdCycle(const Request& r) const;
 
+        // Power accounting
+        void idleCycles(uint32_t rank, uint64_t memCycle, uint64_t& stbyCycles, uint64_t& pdCycles) const;
+        void samplePower(uint32_t rank, uint64_t memCycle);
+        uint64_t curMemCycle() const;
+        inline bool isPoweredDown(uint32_t rank, uint64_t memCycle) const {
+            return powerDownIdle && memCycle > rankPower[rank].lastCmdCycle + powerDownIdle;
+        }
+        // Per-event energies in pJ: current (mA) x VDD (V) x time (ns) for every device in the rank
+        inline double energyPJ(double mAxCycles) const { return mAxCycles*VDD*tCKns*devicesPerRank; }
+        double actEnergy() const;
+        double rdEnergy() const;
+        double wrEnergy() const;
+        double refEnergy() const;
+        double bgEnergy() const;
+
+        // Whether a request for loc that arrived at arrivalCycle finds its row
+        // open (rows stay open past closeCycle if a request for them is waiting)
+        inline bool isRowHit(const Bank& bank, const AddrLoc& loc, uint64_t arrivalCycle) const {
+            return bank.open && loc.row == bank.openRow && arrivalCycle < bank.closeCycle;
+        }
+        // PRE cycle for a row miss on an open bank: on demand, or at closeCycle if that's earlier
+        inline uint64_t openBankPreCycle(const Bank& bank, uint64_t arrivalCycle) const {
+            return std::min(bank.closeCycle, std::max(arrivalCycle, bank.minPreCycle));
+        }
+
+        // Banks in a rank are striped across groups, so consecutive banks are in different groups
+        inline uint32_t groupIdx(const AddrLoc& loc) const { return loc.rank*bankGroups + loc.bank % bankGroups; }
+        inline uint64_t minGroupActCycle(const AddrLoc& loc) const {
+            return std::max(groupLastActCycle[groupIdx(loc)] + tRRD_L, rankLastActCycle[loc.rank] + tRRD_S);
+        }
+        inline uint64_t minGroupCasCycle(const AddrLoc& loc) const {
+            return std::max(groupLastCasCycle[groupIdx(loc)] + tCCD_L, rankLastCasCycle[loc.rank] + tCCD_S);
+        }
+
+        // Data bus cycles to transfer data_size 16-byte bursts
+        inline uint32_t busCycles(uint32_t data_size) const {
+            return (16*data_size + busBytesPerCycle - 1)/busBytesPerCycle;
+        }
+
+        inline Request* bankHead(uint32_t bankId, bool wrQueue) const {
+            const Bank* bank = &banks[bankId];
+            return wrQueue? bank->wrReqs.front() : bank->rdReqs.front();
+        }
+        void updateHead(uint32_t rank, uint32_t bank, bool wrQueue);
+        void trackHeads(bool wrQueue);  // activates the head tracker
+
         void initTech(const char* tech, double time_scale);
 };
 
+/* Options of a DDR channel, read from a config prefix (e.g., "sys.mem.").
+ * Every DDRMemory builder reads them through this, so they all share the
+ * same option names and defaults.
+ */
+struct DDRMemoryConfig {
+    uint32_t ranksPerChannel;
+    uint32_t banksPerRank;
+    uint32_t pageSize;
+    const char* tech;
+    const char* addrMapping;
+    bool deferWrites;
+    bool closedPage;
+    uint32_t maxRowHits;
+    uint32_t queueDepth;
+    uint32_t controllerLatency;  // in system cycles
+    bool bankXorHash;
+
+    uint32_t bulkChunkBursts;
+    uint32_t bulkMaxChunks;
+    bool bulkDemandFirst;
+
+    uint32_t wrHighWatermark;
+    uint32_t wrLowWatermark;
+    bool adaptiveDrain;
+    uint32_t drainReadLimit;
+    uint32_t writeBufferLines;
+
+    DDRMemory::RowPolicy rowPolicy;
+    uint32_t rowTimeout;
+
+    uint32_t powerDownIdle;
+
+    DDRMemoryConfig(Config& config, const std::string& prefix);
+};
+
 
 #endif  // DDR_MEM_H_
@@ -0,0 +1,111 @@
+#include "dram_cache_layout.h"
+#include <algorithm>
+#include <string>
+#include "log.h"
+#include "zsim.h"
+
+DramCacheLayout::DramCacheLayout(Config & config, uint32_t num_ways, uint32_t block_lines, bool tad)
+	: _tad(tad), _num_ways(num_ways), _block_lines(block_lines)
+{
+	std::string layout = config.get<const char *>("sys.mem.mcdram.layout", "address");
+	if (layout == "address")
+		_set_layout = false;
+	else if (layout == "set")
+		_set_layout = true;
+	else
+		panic("Invalid sys.mem.mcdram.layout %s (address/set)", layout.c_str());
+
+	_row_lines = config.get<uint32_t>("sys.mem.mcdram.layoutRowLines", 32);  // 2KB rows
+	_row_stride = config.get<uint32_t>("sys.mem.mcdram.layoutRowStride", 1);
+	_meta_lines = config.get<uint32_t>("sys.mem.mcdram.layoutMetaLines", 1);
+	_tad_bytes = config.get<uint32_t>("sys.mem.mcdram.layoutTadBytes", 72);  // 64B data + 8B tag
+	uint32_t map_granu = config.get<uint32_t>("sys.mem.mcdram.mapGranu", 64);
+	if (!_set_layout)
+		return;
+
+	if (!_row_lines || map_granu % _row_lines)
+		panic("layoutRowLines (%d) must divide the mcdram mapGranu (%d)", _row_lines, map_granu);
+	if (!_row_stride)
+		panic("layoutRowStride must be non-zero");
+	std::string mapping = config.get<const char *>("sys.mem.mcdram.addrMapping", "rank:col:bank");
+	if (mapping.size() < 4 || mapping.compare(mapping.size() - 4, 4, ":col"))
+		warn("DRAM cache set layout with mcdram addrMapping %s: consecutive lines are not in the same row, use a col-lowest mapping",
+				mapping.c_str());
+	if (_tad) {
+		assert(_num_ways == 1 && _block_lines == 1);
+		_sets_per_row = _row_lines * zinfo->lineSize / _tad_bytes;
+		if (!_sets_per_row)
+			panic("layoutTadBytes (%d) larger than a row", _tad_bytes);
+		_set_lines = 1;
+		_rows_per_set = 1;
+		info("DRAM cache layout: %ld TADs per %d-line row", _sets_per_row, _row_lines);
+	} else {
+		if (!_meta_lines)
+			panic("layoutMetaLines must be non-zero (tags live in the set's first line)");
+		_set_lines = _meta_lines + (uint64_t) _num_ways * _block_lines;
+		_sets_per_row = _row_lines / _set_lines;
+		_rows_per_set = (_set_lines + _row_lines - 1) / _row_lines;
+		if (_sets_per_row) {
+			info("DRAM cache layout: %ld sets of %ld lines per %d-line row", _sets_per_row, _set_lines, _row_lines);
+		} else {
+			info("DRAM cache layout: %ld rows per set, %d rows apart", _rows_per_set, _row_stride);
+		}
+	}
+}
+
+Address
+DramCacheLayout::setLine(uint64_t set_num, uint64_t offset) const
+{
+	assert(offset < _set_lines);
+	if (_sets_per_row)
+		return set_num / _sets_per_row * _row_lines + set_num % _sets_per_row * _set_lines + offset;
+	// Groups of _row_stride sets interleave their rows, so that the k-th
+	// row of a set is _row_stride rows after its (k-1)-th
+	uint64_t group = set_num / _row_stride;
+	uint64_t row = (group * _rows_per_set + offset / _row_lines) * _row_stride + set_num % _row_stride;
+	return row * _row_lines + offset % _row_lines;
+}
+
+Address
+DramCacheLayout::tadLine(uint64_t set_num) const
+{
+	uint64_t slot = set_num % _sets_per_row;
+	return set_num / _sets_per_row * _row_lines + slot * _tad_bytes / zinfo->lineSize;
+}
+
+Address
+DramCacheLayout::tagLine(uint64_t set_num, Address line_addr) const
+{
+	if (!_set_layout)
+		return line_addr;
+	return _tad? tadLine(set_num) : setLine(set_num, 0);
+}
+
+Address
+DramCacheLayout::counterLine(uint64_t set_num, Address line_addr) const
+{
+	if (!_set_layout)
+		return line_addr;
+	return _tad? tadLine(set_num) : setLine(set_num, _meta_lines - 1);
+}
+
+Address
+DramCacheLayout::dataLine(uint64_t set_num, uint32_t way, Address line_addr) const
+{
+	if (!_set_layout)
+		return line_addr;
+	if (_tad)
+		return tadLine(set_num);
+	assert(way < _num_ways);
+	return setLine(set_num, _meta_lines + (uint64_t) way * _block_lines + line_addr % _block_lines);
+}
+
+uint64_t
+DramCacheLayout::contiguousLines(uint64_t set_num, uint32_t way, uint64_t block_offset) const
+{
+	assert(block_offset < _block_lines);
+	if (!_set_layout || _sets_per_row)
+		return _block_lines - block_offset;  // whole set in one row
+	uint64_t offset = _meta_lines + (uint64_t) way * _block_lines + block_offset;
+	return std::min<uint64_t>(_block_lines - block_offset, _row_lines - offset % _row_lines);
+}
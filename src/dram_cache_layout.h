@@ -0,0 +1,58 @@
+#pragma once
+
+#include "config.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+
+/* Places the DRAM cache's sets in the in-package DRAM (mcdram) address space.
+ *
+ * With layout = "address" (the default), every access goes to the line it
+ * was issued for, so a set's tags, counters and ways land in unrelated rows.
+ *
+ * With layout = "set", each set gets a contiguous region: its metadata lines
+ * (tags, then replacement counters in the last one) followed by its ways.
+ * Regions are packed into rows of layoutRowLines lines without straddling a
+ * row, so when a set fits in a row its tag probes, counter updates and data
+ * accesses all hit the same row. Larger sets (e.g., 4KB pages) take several
+ * rows, placed layoutRowStride rows apart; a stride of channels x ranks x
+ * banks keeps all of a set's rows in the same bank. Alloy Cache keeps tags
+ * with the data (TADs), which are packed back to back, layoutTadBytes apart,
+ * in each row (28 per 2KB row).
+ *
+ * Layout rows only match DRAM rows if consecutive mcdram lines share a row:
+ * use a col-lowest addrMapping (e.g., "rank:bank:col"), and set
+ * layoutRowLines to the lines per row, dividing the mcdram mapGranu so rows
+ * do not straddle channels. Only accesses to a known set use the layout; HMA
+ * page migrations and CacheOnly accesses keep their own addresses.
+ */
+class DramCacheLayout : public GlobAlloc {
+public:
+	DramCacheLayout(Config & config, uint32_t num_ways, uint32_t block_lines, bool tad);
+
+	// mcdram line of the set's tags (or TAD) when accessing line_addr
+	Address tagLine(uint64_t set_num, Address line_addr) const;
+	// mcdram line of the set's replacement counters
+	Address counterLine(uint64_t set_num, Address line_addr) const;
+	// mcdram line of line_addr, cached in way of set_num
+	Address dataLine(uint64_t set_num, uint32_t way, Address line_addr) const;
+	// Lines of way's block, starting at block_offset, that are contiguous in
+	// mcdram (page fills and evictions are split at these boundaries)
+	uint64_t contiguousLines(uint64_t set_num, uint32_t way, uint64_t block_offset) const;
+
+	bool isSetLayout() const { return _set_layout; };
+private:
+	Address setLine(uint64_t set_num, uint64_t offset) const;
+	Address tadLine(uint64_t set_num) const;
+
+	bool _set_layout;
+	bool _tad;
+	uint32_t _num_ways;
+	uint32_t _block_lines;
+	uint32_t _meta_lines;
+	uint32_t _row_lines;
+	uint32_t _row_stride;
+	uint32_t _tad_bytes;
+	uint64_t _set_lines;     // metadata + data lines per set
+	uint64_t _sets_per_row;  // 0 if a set spans several rows
+	uint64_t _rows_per_set;
+};
@@ -0,0 +1,254 @@
+#include "dram_cache_profiler.h"
+#include <algorithm>
+#include <stdio.h>
+#include "hash.h"
+#include "rng.h"
+#include "zsim.h"
+
+CountMinSketch::CountMinSketch(uint32_t depth, uint32_t width_bits, uint64_t seed)
+	: _depth(depth), _width(1 << width_bits)
+{
+	assert(_depth <= MAX_DEPTH);
+	_counters = gm_calloc<uint32_t>(_depth * _width);
+	_hash = new H3HashFamily(_depth, width_bits, seed);
+}
+
+uint64_t 
+CountMinSketch::inc(Address key)
+{
+	// Conservative update: only raise the counters that hold the minimum
+	uint32_t * slots[MAX_DEPTH];
+	uint32_t min = (uint32_t) -1;
+	for (uint32_t i = 0; i < _depth; i++) {
+		slots[i] = &_counters[i * _width + (_hash->hash(i, key) & (_width - 1))];
+		min = std::min(min, *slots[i]);
+	}
+	if (min == (uint32_t) -1)
+		return min; // saturated
+	for (uint32_t i = 0; i < _depth; i++)
+		if (*slots[i] == min)
+			(*slots[i]) ++;
+	return min + 1;
+}
+
+void 
+CountMinSketch::decay()
+{
+	for (uint32_t i = 0; i < _depth * _width; i++)
+		_counters[i] /= 2;
+}
+
+void 
+TopPages::init(uint32_t n)
+{
+	_max_size = n;
+	_heap.reserve(n);
+}
+
+void 
+TopPages::update(Address tag, uint64_t count)
+{
+	auto it = _pos.find(tag);
+	if (it != _pos.end()) {
+		// Count only grows, so the entry can only move towards the leaves
+		_heap[it->second].count = count;
+		siftDown(it->second);
+	} else if (_heap.size() < _max_size) {
+		_heap.push_back(Entry {tag, count, (uint64_t) -1, 0, 0});
+		uint32_t idx = _heap.size() - 1;
+		_pos[tag] = idx;
+		while (idx && _heap[(idx - 1) / 2].count > _heap[idx].count) {
+			swap(idx, (idx - 1) / 2);
+			idx = (idx - 1) / 2;
+		}
+	} else if (_max_size && count > _heap[0].count) {
+		_pos.erase(_heap[0].tag);
+		_heap[0] = Entry {tag, count, (uint64_t) -1, 0, 0};
+		_pos[tag] = 0;
+		siftDown(0);
+	}
+}
+
+void 
+TopPages::recordFill(Address tag, uint64_t cycle)
+{
+	auto it = _pos.find(tag);
+	if (it != _pos.end())
+		_heap[it->second].fill_cycle = cycle;
+}
+
+void 
+TopPages::recordEviction(Address tag, uint64_t cycle)
+{
+	auto it = _pos.find(tag);
+	if (it == _pos.end())
+		return;
+	Entry & e = _heap[it->second];
+	if (e.fill_cycle != (uint64_t) -1 && cycle >= e.fill_cycle) {
+		e.residency += cycle - e.fill_cycle;
+		e.evictions ++;
+	}
+	e.fill_cycle = (uint64_t) -1;
+}
+
+void 
+TopPages::decay()
+{
+	// Halving preserves the heap order
+	for (uint32_t i = 0; i < _heap.size(); i++)
+		_heap[i].count /= 2;
+}
+
+void 
+TopPages::siftDown(uint32_t idx)
+{
+	while (true) {
+		uint32_t smallest = idx;
+		uint32_t left = 2 * idx + 1;
+		uint32_t right = left + 1;
+		if (left < _heap.size() && _heap[left].count < _heap[smallest].count)
+			smallest = left;
+		if (right < _heap.size() && _heap[right].count < _heap[smallest].count)
+			smallest = right;
+		if (smallest == idx)
+			return;
+		swap(idx, smallest);
+		idx = smallest;
+	}
+}
+
+void 
+TopPages::swap(uint32_t i, uint32_t j)
+{
+	std::swap(_heap[i], _heap[j]);
+	_pos[_heap[i].tag] = i;
+	_pos[_heap[j].tag] = j;
+}
+
+DramCacheProfiler::DramCacheProfiler(Config & config, const g_string & name, uint64_t num_sets)
+	: _num_sets(num_sets), _num_accesses(0)
+{
+	_num_buckets = config.get<uint32_t>("sys.mem.profiler.setBuckets", 256);
+	if (_num_buckets > _num_sets)
+		_num_buckets = _num_sets;
+	_top_n = config.get<uint32_t>("sys.mem.profiler.topN", 32);
+	_interval = config.get<uint32_t>("sys.mem.profiler.interval", 1000000);
+	uint32_t depth = config.get<uint32_t>("sys.mem.profiler.sketchDepth", 4);
+	uint32_t width_bits = config.get<uint32_t>("sys.mem.profiler.sketchWidthBits", 14);
+	assert(_interval > 0);
+	assert(depth > 0 && width_bits > 0 && width_bits <= 24);
+
+	const char * file = config.get<const char *>("sys.mem.profiler.file", "");
+	if (file[0]) {
+		_file = g_string(file) + g_string("-") + name + g_string(".bin");
+		FILE * f = fopen(_file.c_str(), "wb");
+		if (!f) panic("Could not open DRAM cache profile file %s", _file.c_str());
+		fclose(f);
+	}
+
+	_access_sketch = new CountMinSketch(depth, width_bits, DeriveSeed(zinfo->seed, (name + "-access-sketch").c_str()));
+	_evict_sketch = new CountMinSketch(depth, width_bits, DeriveSeed(zinfo->seed, (name + "-evict-sketch").c_str()));
+	_hot_pages.init(_top_n);
+	_thrash_pages.init(_top_n);
+	_interval_misses = gm_calloc<uint64_t>(_num_buckets);
+	_interval_fills = gm_calloc<uint64_t>(_num_buckets);
+}
+
+void 
+DramCacheProfiler::initStats(AggregateStat * parentStat)
+{
+	AggregateStat * profStats = new AggregateStat();
+	profStats->init("profiler", "DRAM cache hot-page and per-set profile");
+	_setMisses.init("setMisses", "Misses per set bucket", _num_buckets); profStats->append(&_setMisses);
+	_setFills.init("setFills", "Fills per set bucket", _num_buckets); profStats->append(&_setFills);
+
+	// Heap order; entries past the current size read as 0
+	TopPages * hot = &_hot_pages;
+	TopPages * thrash = &_thrash_pages;
+	auto hotTag = [hot](uint32_t i) { return (i < hot->size())? hot->get(i).tag : 0; };
+	auto hotCount = [hot](uint32_t i) { return (i < hot->size())? hot->get(i).count : 0; };
+	auto hotRes = [hot](uint32_t i) { return (i < hot->size())? hot->avgResidency(i) : 0; };
+	auto thrashTag = [thrash](uint32_t i) { return (i < thrash->size())? thrash->get(i).tag : 0; };
+	auto thrashCount = [thrash](uint32_t i) { return (i < thrash->size())? thrash->get(i).count : 0; };
+	auto thrashRes = [thrash](uint32_t i) { return (i < thrash->size())? thrash->avgResidency(i) : 0; };
+	auto hotTagStat = makeLambdaVectorStat(hotTag, _top_n);
+	hotTagStat->init("hotPageTag", "Hottest pages"); profStats->append(hotTagStat);
+	auto hotCountStat = makeLambdaVectorStat(hotCount, _top_n);
+	hotCountStat->init("hotPageAccesses", "Estimated (decayed) accesses to hottest pages"); profStats->append(hotCountStat);
+	auto hotResStat = makeLambdaVectorStat(hotRes, _top_n);
+	hotResStat->init("hotPageResidency", "Average residency of hottest pages (cycles)"); profStats->append(hotResStat);
+	auto thrashTagStat = makeLambdaVectorStat(thrashTag, _top_n);
+	thrashTagStat->init("thrashPageTag", "Most evicted pages"); profStats->append(thrashTagStat);
+	auto thrashCountStat = makeLambdaVectorStat(thrashCount, _top_n);
+	thrashCountStat->init("thrashPageEvictions", "Estimated (decayed) evictions of most evicted pages"); profStats->append(thrashCountStat);
+	auto thrashResStat = makeLambdaVectorStat(thrashRes, _top_n);
+	thrashResStat->init("thrashPageResidency", "Average residency of most evicted pages (cycles)"); profStats->append(thrashResStat);
+
+	parentStat->append(profStats);
+}
+
+void 
+DramCacheProfiler::recordAccess(uint64_t set_num, Address tag, bool hit, uint64_t cycle)
+{
+	_hot_pages.update(tag, _access_sketch->inc(tag));
+	if (!hit) {
+		uint32_t bucket = getBucket(set_num);
+		_setMisses.inc(bucket);
+		_interval_misses[bucket] ++;
+	}
+	if (++_num_accesses % _interval == 0)
+		sample(cycle);
+}
+
+void 
+DramCacheProfiler::recordFill(uint64_t set_num, Address tag, uint64_t cycle)
+{
+	uint32_t bucket = getBucket(set_num);
+	_setFills.inc(bucket);
+	_interval_fills[bucket] ++;
+	_hot_pages.recordFill(tag, cycle);
+	_thrash_pages.recordFill(tag, cycle);
+}
+
+void 
+DramCacheProfiler::recordEviction(uint64_t set_num, Address tag, uint64_t cycle)
+{
+	_hot_pages.recordEviction(tag, cycle);
+	_thrash_pages.recordEviction(tag, cycle);
+	_thrash_pages.update(tag, _evict_sketch->inc(tag));
+}
+
+void 
+DramCacheProfiler::sample(uint64_t cycle)
+{
+	if (_file.length()) {
+		FILE * f = fopen(_file.c_str(), "ab");
+		fwrite(&cycle, sizeof(uint64_t), 1, f);
+		fwrite(&_num_accesses, sizeof(uint64_t), 1, f);
+		fwrite(&_num_buckets, sizeof(uint32_t), 1, f);
+		fwrite(&_top_n, sizeof(uint32_t), 1, f);
+		fwrite(_interval_misses, sizeof(uint64_t), _num_buckets, f);
+		fwrite(_interval_fills, sizeof(uint64_t), _num_buckets, f);
+		TopPages * tops[2] = {&_hot_pages, &_thrash_pages};
+		for (TopPages * top : tops) {
+			for (uint32_t i = 0; i < _top_n; i++) {
+				uint64_t rec[3] = {0, 0, 0};
+				if (i < top->size()) {
+					rec[0] = top->get(i).tag;
+					rec[1] = top->get(i).count;
+					rec[2] = top->avgResidency(i);
+				}
+				fwrite(rec, sizeof(uint64_t), 3, f);
+			}
+		}
+		fclose(f);
+	}
+	for (uint32_t i = 0; i < _num_buckets; i++) {
+		_interval_misses[i] = 0;
+		_interval_fills[i] = 0;
+	}
+	_access_sketch->decay();
+	_evict_sketch->decay();
+	_hot_pages.decay();
+	_thrash_pages.decay();
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "config.h"
+#include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class H3HashFamily;
+
+// Count-min sketch with conservative update: estimates never undercount, and
+// overcount by at most ~e*total/width with high probability.
+class CountMinSketch : public GlobAlloc {
+public:
+	CountMinSketch(uint32_t depth, uint32_t width_bits, uint64_t seed);
+	// Adds one to the key's count and returns its new estimate
+	uint64_t inc(Address key);
+	void decay(); // halves all counters
+	static const uint32_t MAX_DEPTH = 8;
+private:
+	uint32_t _depth;
+	uint32_t _width;
+	uint32_t * _counters;  // [depth][width]
+	H3HashFamily * _hash;
+};
+
+// Bounded set of the N pages with the highest count: a min-heap on count
+// plus a tag -> heap position index. Members also track residency time
+// (fill to eviction) in the DRAM cache.
+class TopPages {
+public:
+	struct Entry {
+		Address tag;
+		uint64_t count;
+		uint64_t fill_cycle;  // -1 if not resident (or fill not seen)
+		uint64_t residency;   // total resident cycles over tracked evictions
+		uint64_t evictions;   // tracked evictions
+	};
+
+	void init(uint32_t n);
+	// count is the page's new (estimated) count; it only grows between decays
+	void update(Address tag, uint64_t count);
+	void recordFill(Address tag, uint64_t cycle);
+	void recordEviction(Address tag, uint64_t cycle);
+	void decay();
+
+	uint32_t size() const { return _heap.size(); };
+	const Entry & get(uint32_t idx) const { return _heap[idx]; };
+	uint64_t avgResidency(uint32_t idx) const 
+		{ return _heap[idx].evictions? _heap[idx].residency / _heap[idx].evictions : 0; };
+private:
+	void siftDown(uint32_t idx);
+	void swap(uint32_t i, uint32_t j);
+
+	uint32_t _max_size;
+	g_vector<Entry> _heap;
+	g_unordered_map<Address, uint32_t> _pos;
+};
+
+/* Hot-page and per-set heatmap profiler for the DRAM cache.
+ *
+ * Sets are folded into a fixed number of buckets. Page popularity (accesses)
+ * and thrashing (evictions) are estimated with count-min sketches, and the
+ * top-N pages of each are kept in bounded heaps, so memory does not grow with
+ * the footprint and the profiler can stay on in long runs.
+ *
+ * Results are exported as vector stats. Optionally, every `interval` requests
+ * a record is appended to a binary side file:
+ *   uint64_t cycle, requests; uint32_t buckets, topN;
+ *   uint64_t setMisses[buckets], setFills[buckets];  // since previous record
+ *   {uint64_t tag, accesses, avgResidency} hot[topN];  // zero-padded
+ *   {uint64_t tag, evictions, avgResidency} thrash[topN];
+ * Sketches and heaps are halved after each record, so rankings favor recent
+ * behavior.
+ */
+class DramCacheProfiler : public GlobAlloc {
+public:
+	DramCacheProfiler(Config & config, const g_string & name, uint64_t num_sets);
+	void initStats(AggregateStat * parentStat);
+
+	void recordAccess(uint64_t set_num, Address tag, bool hit, uint64_t cycle);
+	void recordFill(uint64_t set_num, Address tag, uint64_t cycle);
+	void recordEviction(uint64_t set_num, Address tag, uint64_t cycle);
+private:
+	uint32_t getBucket(uint64_t set_num) { return set_num * _num_buckets / _num_sets; };
+	void sample(uint64_t cycle);
+
+	uint64_t _num_sets;
+	uint32_t _num_buckets;
+	uint32_t _top_n;
+	uint64_t _interval;
+	uint64_t _num_accesses;
+	g_string _file;
+
+	CountMinSketch * _access_sketch;
+	CountMinSketch * _evict_sketch;
+	TopPages _hot_pages;
+	TopPages _thrash_pages;
+
+	uint64_t * _interval_misses;
+	uint64_t * _interval_fills;
+
+	// Stats
+	VectorCounter _setMisses;
+	VectorCounter _setFills;
+};
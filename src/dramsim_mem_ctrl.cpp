@@ -24,7 +24,6 @@
  */
 
 #include "dramsim_mem_ctrl.h"
-#include <map>
 #include <string>
 #include "event_recorder.h"
 #include "tick_event.h"
@@ -171,7 +170,14 @@ uint64_t DRAMSimMemory::access(MemReq& req, int type, uint32_t data_size) {
     return respCycle;
 }
 
+/* DRAMSim2 has no way to skip cycles, and an idle update() (refresh and
+ * power-down state) costs far more than the tick event around it. So
+ * ticks run every cycle, even while idle: batching idle updates would only
+ * save the event, and would change the order of a request and the update()
+ * of the cycle it arrives on, which the domain queue decides.
+ */
 uint32_t DRAMSimMemory::tick(uint64_t cycle) {
+    assert(curCycle == cycle);
     dramCore->update();
     curCycle++;
     return 1;
@@ -180,14 +186,16 @@ uint32_t DRAMSimMemory::tick(uint64_t cycle) {
 void DRAMSimMemory::enqueue(DRAMSimAccEvent* ev, uint64_t cycle) {
     //info("[%s] %s access to %lx added at %ld, %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", ev->getAddr(), cycle, inflightRequests.size());
     dramCore->addTransaction(ev->isWrite(), ev->getAddr());
-    inflightRequests.insert(std::pair<Address, DRAMSimAccEvent*>(ev->getAddr(), ev));
+    inflightRequests[ev->getAddr()].push_back(ev);
     ev->hold();
 }
 
 void DRAMSimMemory::DRAM_read_return_cb(uint32_t id, uint64_t addr, uint64_t memCycle) {
-    std::multimap<uint64_t, DRAMSimAccEvent*>::iterator it = inflightRequests.find(addr);
+    auto it = inflightRequests.find(addr);
     assert((it != inflightRequests.end()));
-    DRAMSimAccEvent* ev = it->second;
+    DRAMSimAccEvent* ev = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) inflightRequests.erase(it);
 
     uint32_t lat = curCycle+1 - ev->sCycle;
     if (ev->isWrite()) {
@@ -200,8 +208,7 @@ void DRAMSimMemory::DRAM_read_return_cb(uint32_t id, uint64_t addr, uint64_t mem
 
     ev->release();
     ev->done(curCycle+1);
-    inflightRequests.erase(it);
-    //info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), it->second->isWrite()? "Write" : "Read", it->second->getAddr(), curCycle, curCycle-it->second->sCycle, inflightRequests.size());
+    //info("[%s] %s access to %lx DONE at %ld (%ld cycles), %ld inflight reqs", getName(), ev->isWrite()? "Write" : "Read", addr, curCycle, curCycle-ev->sCycle, inflightRequests.size());
 }
 
 void DRAMSimMemory::DRAM_write_return_cb(uint32_t id, uint64_t addr, uint64_t memCycle) {
@@ -80,6 +80,10 @@ class EventRecorder : public GlobAlloc {
             return slabAlloc.alloc(sz);
         }
 
+        void initStats(AggregateStat* parentStat) {
+            slabAlloc.initStats(parentStat);
+        }
+
         //Event recording interface
 
         void pushRecord(const TimingRecord& rec) {
@@ -29,6 +29,7 @@
 #include "bithacks.h"
 #include "cache.h"
 #include "galloc.h"
+#include "rng.h"
 #include "zsim.h"
 #include "g_std/g_unordered_map.h"
 #include "g_std/g_unordered_set.h"
@@ -64,7 +65,7 @@ class FilterCache : public Cache {
         uint64_t fGETSHit, fGETXHit;
 		// this is not an accurate tlb. It just randomize the page nums   
 		bool _enable_tlb;
-		drand48_data _buffer;
+		Rng _rng;
 		g_unordered_map <Address, Address> _tlb;
 		g_unordered_set <Address> _exist_pgnum; 
     public:
@@ -81,7 +82,7 @@ class FilterCache : public Cache {
             srcId = -1;
             reqFlags = 0;
 			_enable_tlb = config.get<bool>("sim.enableTLB", false);
-			srand48_r((uint64_t)this, &_buffer);
+			_rng.init(DeriveSeed(zinfo->seed, _name.c_str()));
         }
 
         void setSourceId(uint32_t id) {
@@ -142,9 +143,8 @@ class FilterCache : public Cache {
         	    futex_lock(&filterLock);
 				if (_tlb.find(vpgnum) == _tlb.end()) {
 					do {
-						int64_t rand;
-						lrand48_r(&_buffer, &rand);
-						pgnum = rand & 0x000fffffffffffff;
+						// 31-bit page numbers, as with the old lrand48 draw
+						pgnum = _rng.next() >> 33;
 					} while (_exist_pgnum.find(pgnum) != _exist_pgnum.end());
 					_tlb[vpgnum] = pgnum;
 					_exist_pgnum.insert( pgnum );
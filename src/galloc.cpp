@@ -27,8 +27,10 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include <string>
 #include <sys/ipc.h>
+#include <sys/mman.h>
 #include <sys/shm.h>
 
 #include "log.h"  // NOLINT must precede dlmalloc, which defines assert if undefined
@@ -50,21 +52,60 @@
  */
 #define GM_BASE_ADDR ((const void*)0x00ABBA000000)
 
+/* Arenas: Small allocations (up to GM_MAX_SMALL bytes) are served from
+ * per-arena free lists of fixed-size blocks, and each thread uses the arena of
+ * the host CPU it runs on. Arenas carve their blocks from slabs of
+ * GM_SLAB_BYTES, allocated from the mspace (under the global lock) only when
+ * their lists run dry. Each slab holds a single size class, recorded in
+ * slabClass, so frees need no block headers. Frees are lock-free: they push
+ * the block to the remote list of the freeing CPU's arena, which the arena's
+ * lock holder takes whole on its next allocation (so there is no ABA).
+ * Allocations take the arena's lock, which is only contended when a thread
+ * is preempted while holding it. Larger and aligned allocations use the
+ * mspace directly, under the global lock.
+ */
+#define GM_MAX_ARENAS 64
+#define GM_SLAB_BYTES (16*1024)
+#define GM_NUM_CLASSES 12
+#define GM_MAX_SMALL 1024
+static const uint32_t gm_class_sizes[GM_NUM_CLASSES] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024};
+
+struct gm_arena {
+    lock_t lock;
+    void* freeList[GM_NUM_CLASSES]; //lock holder only
+    uint64_t allocs;
+    uint64_t contended; //allocations that found this arena locked
+    uint64_t refills;
+
+    PAD();
+    void* volatile remoteFree[GM_NUM_CLASSES]; //lock-free LIFOs, linked through the blocks' first word
+    PAD();
+};
+
 struct gm_segment {
     volatile void* base_regp; //common data structure, accessible with glob_ptr; threads poll on gm_isready to determine when everything has been initialized
     volatile void* secondary_regp; //secondary data structure, used to exchange information between harness and initializing process
     mspace mspace_ptr;
+    size_t size; //whole segment, in bytes
+    uint32_t hugePages; //GM_HUGE_*
+
+    uint32_t numArenas; //0 if all allocations use the mspace
+    uint8_t* slabClass; //per GM_SLAB_BYTES of the segment, size class + 1 if it is an arena slab, 0 otherwise
+    uint64_t largeAllocs; //under lock
+    volatile uint64_t hostTlbMisses;
 
     PAD();
     lock_t lock;
     PAD();
+
+    gm_arena arenas[GM_MAX_ARENAS];
 };
 
 static gm_segment* GM = nullptr;
 static int gm_shmid = 0;
 
 /* Heap segment size, in bytes. Can't grow for now, so choose something sensible, and within the machine's limits (see sysctl vars kernel.shmmax and kernel.shmall) */
-int gm_init(size_t segmentSize) {
+int gm_init(size_t segmentSize, uint32_t numArenas, bool hugePages) {
     /* Create a SysV IPC shared memory segment, attach to it, and mark the segment to
      * auto-destroy when the number of attached processes becomes 0.
      *
@@ -76,7 +117,20 @@ int gm_init(size_t segmentSize) {
 
     assert(GM == nullptr);
     assert(gm_shmid == 0);
-    gm_shmid = shmget(IPC_PRIVATE, segmentSize, 0644 | IPC_CREAT /*| SHM_HUGETLB*/);
+    uint32_t hugeMode = GM_HUGE_NONE;
+    gm_shmid = -1;
+    if (hugePages) {
+        //hugetlbfs pages must be reserved beforehand (vm.nr_hugepages); if there are not enough, fall back to THP
+        size_t hugeSize = (segmentSize + (2<<20) - 1) & ~((size_t)(2<<20) - 1);
+        gm_shmid = shmget(IPC_PRIVATE, hugeSize, 0644 | IPC_CREAT | SHM_HUGETLB);
+        if (gm_shmid != -1) {
+            segmentSize = hugeSize;
+            hugeMode = GM_HUGE_HUGETLB;
+        } else {
+            perror("gm_create: shmget with SHM_HUGETLB failed, falling back to regular pages");
+        }
+    }
+    if (gm_shmid == -1) gm_shmid = shmget(IPC_PRIVATE, segmentSize, 0644 | IPC_CREAT);
     if (gm_shmid == -1) {
         perror("gm_create failed shmget");
         exit(1);
@@ -98,14 +152,36 @@ int gm_init(size_t segmentSize) {
     int ret = shmctl(gm_shmid, IPC_RMID, nullptr);
     assert(!ret);
 
-    char* alloc_start = reinterpret_cast<char*>(GM) + 1024;
-    size_t alloc_size = segmentSize - 1 - 1024;
+    //Transparent huge pages only back shared memory if /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it
+    if (hugePages && hugeMode == GM_HUGE_NONE && madvise(GM, segmentSize, MADV_HUGEPAGE) == 0) hugeMode = GM_HUGE_THP;
+
+    size_t headerSize = (sizeof(gm_segment) + 4095) & ~((size_t)4095);
+    char* alloc_start = reinterpret_cast<char*>(GM) + headerSize;
+    size_t alloc_size = segmentSize - 1 - headerSize;
     GM->base_regp = nullptr;
+    GM->size = segmentSize;
+    GM->hugePages = hugeMode;
 
-    GM->mspace_ptr = create_mspace_with_base(alloc_start, alloc_size, 1 /*locked*/);
+    GM->mspace_ptr = create_mspace_with_base(alloc_start, alloc_size, 0 /*we lock*/);
     futex_init(&GM->lock);
     assert(GM->mspace_ptr);
 
+    GM->numArenas = (numArenas < GM_MAX_ARENAS)? numArenas : GM_MAX_ARENAS;
+    GM->slabClass = static_cast<uint8_t*>(mspace_calloc(GM->mspace_ptr, segmentSize/GM_SLAB_BYTES + 1, 1));
+    GM->largeAllocs = 0;
+    GM->hostTlbMisses = 0;
+    for (uint32_t a = 0; a < GM_MAX_ARENAS; a++) {
+        gm_arena& arena = GM->arenas[a];
+        futex_init(&arena.lock);
+        for (uint32_t c = 0; c < GM_NUM_CLASSES; c++) {
+            arena.freeList[c] = nullptr;
+            arena.remoteFree[c] = nullptr;
+        }
+        arena.allocs = 0;
+        arena.contended = 0;
+        arena.refills = 0;
+    }
+
     return gm_shmid;
 }
 
@@ -121,11 +197,72 @@ void gm_attach(int shmid) {
 }
 
 
+static inline uint32_t gm_size_class(size_t size) {
+    uint32_t c = 0;
+    while (gm_class_sizes[c] < size) c++;
+    return c;
+}
+
+static inline uint32_t gm_slab_class(void* ptr) {
+    return GM->slabClass[(static_cast<char*>(ptr) - reinterpret_cast<char*>(GM))/GM_SLAB_BYTES];
+}
+
+//Called with the arena's lock held
+static void* gm_refill(gm_arena* arena, uint32_t sizeClass) {
+    futex_lock(&GM->lock);
+    char* slab = static_cast<char*>(mspace_memalign(GM->mspace_ptr, GM_SLAB_BYTES, GM_SLAB_BYTES));
+    futex_unlock(&GM->lock);
+    if (!slab) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
+    GM->slabClass[(slab - reinterpret_cast<char*>(GM))/GM_SLAB_BYTES] = sizeClass + 1;
+    arena->refills++;
+
+    //Link the slab's blocks, in address order
+    uint32_t blockSize = gm_class_sizes[sizeClass];
+    uint32_t blocks = GM_SLAB_BYTES/blockSize;
+    for (uint32_t b = 0; b < blocks - 1; b++) {
+        *reinterpret_cast<void**>(slab + b*blockSize) = slab + (b+1)*blockSize;
+    }
+    *reinterpret_cast<void**>(slab + (blocks-1)*blockSize) = nullptr;
+    return slab;
+}
+
+static void* gm_small_alloc(uint32_t sizeClass) {
+    int cpu = sched_getcpu();
+    gm_arena* arena = &GM->arenas[((cpu < 0)? 0 : cpu) % GM->numArenas];
+    if (!futex_trylock(&arena->lock)) {
+        //Another thread on this CPU was preempted while holding it. Wait rather than use
+        //another arena, as frees go back to this CPU's arena and others would keep refilling.
+        futex_lock(&arena->lock);
+        arena->contended++;
+    }
+
+    void* ptr = arena->freeList[sizeClass];
+    if (!ptr) ptr = __sync_lock_test_and_set(&arena->remoteFree[sizeClass], nullptr);
+    if (!ptr) ptr = gm_refill(arena, sizeClass);
+    arena->freeList[sizeClass] = *static_cast<void**>(ptr);
+    arena->allocs++;
+    futex_unlock(&arena->lock);
+    return ptr;
+}
+
+static void gm_small_free(void* ptr, uint32_t sizeClass) {
+    int cpu = sched_getcpu();
+    gm_arena* arena = &GM->arenas[((cpu < 0)? 0 : cpu) % GM->numArenas];
+    void* volatile* head = &arena->remoteFree[sizeClass];
+    void* old;
+    do {
+        old = *head;
+        *static_cast<void**>(ptr) = old;
+    } while (!__sync_bool_compare_and_swap(head, old, ptr));
+}
+
 void* gm_malloc(size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
+    if (GM->numArenas && size <= GM_MAX_SMALL) return gm_small_alloc(gm_size_class(size));
     futex_lock(&GM->lock);
     void* ptr = mspace_malloc(GM->mspace_ptr, size);
+    GM->largeAllocs++;
     futex_unlock(&GM->lock);
     if (!ptr) panic("gm_malloc(): Out of global heap memory, use a larger GM segment");
     return ptr;
@@ -134,8 +271,14 @@ void* gm_malloc(size_t size) {
 void* __gm_calloc(size_t num, size_t size) {
     assert(GM);
     assert(GM->mspace_ptr);
+    if (GM->numArenas && num*size <= GM_MAX_SMALL) {
+        void* ptr = gm_small_alloc(gm_size_class(num*size));
+        memset(ptr, 0, num*size);
+        return ptr;
+    }
     futex_lock(&GM->lock);
     void* ptr = mspace_calloc(GM->mspace_ptr, num, size);
+    GM->largeAllocs++;
     futex_unlock(&GM->lock);
     if (!ptr) panic("gm_calloc(): Out of global heap memory, use a larger GM segment");
     return ptr;
@@ -146,6 +289,7 @@ void* __gm_memalign(size_t blocksize, size_t bytes) {
     assert(GM->mspace_ptr);
     futex_lock(&GM->lock);
     void* ptr = mspace_memalign(GM->mspace_ptr, blocksize, bytes);
+    GM->largeAllocs++;
     futex_unlock(&GM->lock);
     if (!ptr) panic("gm_memalign(): Out of global heap memory, use a larger GM segment");
     return ptr;
@@ -155,6 +299,12 @@ void* __gm_memalign(size_t blocksize, size_t bytes) {
 void gm_free(void* ptr) {
     assert(GM);
     assert(GM->mspace_ptr);
+    if (!ptr) return;
+    uint32_t slabClass = GM->numArenas? gm_slab_class(ptr) : 0;
+    if (slabClass) {
+        gm_small_free(ptr, slabClass - 1);
+        return;
+    }
     futex_lock(&GM->lock);
     mspace_free(GM->mspace_ptr, ptr);
     futex_unlock(&GM->lock);
@@ -196,6 +346,36 @@ void* gm_get_secondary_ptr() {
 void gm_stats() {
     assert(GM);
     mspace_malloc_stats(GM->mspace_ptr);
+    gm_counters c;
+    gm_get_counters(&c);
+    info("Global heap: %d arenas, huge pages %d, %ld small allocs (%ld contended, %ld slabs), %ld large allocs",
+         GM->numArenas, c.hugePages, c.smallAllocs, c.contended, c.slabs, c.largeAllocs);
+}
+
+void gm_get_counters(gm_counters* c) {
+    assert(GM);
+    c->smallAllocs = 0;
+    c->contended = 0;
+    c->slabs = 0;
+    for (uint32_t a = 0; a < GM->numArenas; a++) {
+        c->smallAllocs += GM->arenas[a].allocs;
+        c->contended += GM->arenas[a].contended;
+        c->slabs += GM->arenas[a].refills;
+    }
+    c->largeAllocs = GM->largeAllocs;
+    c->hugePages = GM->hugePages;
+    c->hostTlbMisses = GM->hostTlbMisses;
+}
+
+void gm_set_host_tlb_misses(uint64_t misses) {
+    assert(GM);
+    GM->hostTlbMisses = misses;
+}
+
+void gm_segment_bounds(const void** base, size_t* size) {
+    assert(GM);
+    *base = GM;
+    *size = GM->size;
 }
 
 bool gm_isready() {
@@ -26,10 +26,18 @@
 #ifndef GALLOC_H_
 #define GALLOC_H_
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-int gm_init(size_t segmentSize);
+// Huge page backing of the segment
+#define GM_HUGE_NONE 0
+#define GM_HUGE_THP 1  // transparent huge pages (advised, the kernel may not use them)
+#define GM_HUGE_HUGETLB 2  // hugetlbfs pages
+
+// numArenas > 0 serves small allocations from that many per-CPU arenas (see galloc.cpp);
+// hugePages tries hugetlbfs pages, then transparent huge pages
+int gm_init(size_t segmentSize, uint32_t numArenas = 0, bool hugePages = false);
 
 void gm_attach(int shmid);
 
@@ -61,6 +69,20 @@ void* gm_get_secondary_ptr();
 
 void gm_stats();
 
+// Start and size of the shared segment (e.g., to set its NUMA policy)
+void gm_segment_bounds(const void** base, size_t* size);
+
+struct gm_counters {
+    uint64_t smallAllocs;  // served by the arenas
+    uint64_t contended;  // arena locks found held
+    uint64_t slabs;  // arena refills from the shared mspace
+    uint64_t largeAllocs;  // served by the shared mspace, under the global lock
+    uint32_t hugePages;  // GM_HUGE_*
+    uint64_t hostTlbMisses;  // dTLB misses of all simulator processes, sampled by the harness
+};
+void gm_get_counters(gm_counters* c);
+void gm_set_host_tlb_misses(uint64_t misses);
+
 bool gm_isready();
 void gm_detach();
 
@@ -0,0 +1,177 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_placement.h"
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include "config.h"
+#include "log.h"
+
+#define MAX_HOST_NODES 64 //nodes are passed to mbind as a 64-bit mask
+
+//Parses a Linux CPU or node list, e.g., "0-3,8,10-11"
+static std::vector<uint32_t> ParseHostList(const std::string& str, const char* what) {
+    std::vector<uint32_t> res;
+    std::stringstream ss(str);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.find_first_not_of(" \t\n") == std::string::npos) continue;
+        uint32_t first, last;
+        int n = sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (n == 1) last = first;
+        if (n < 1 || last < first) panic("Invalid %s list \"%s\"", what, str.c_str());
+        for (uint32_t i = first; i <= last; i++) res.push_back(i);
+    }
+    return res;
+}
+
+static std::string ReadSysFile(const std::string& path) {
+    std::ifstream ifs(path.c_str());
+    std::string line;
+    if (ifs.good()) std::getline(ifs, line);
+    return line;
+}
+
+HostPlacement::HostPlacement(Config& config) {
+    uint32_t hostCpus = sysconf(_SC_NPROCESSORS_CONF);
+    auto readCpus = [&](const char* name, g_vector<uint32_t>& cpus) {
+        std::string str = config.get<const char*>(std::string("sim.hostPlacement.") + name, "");
+        for (uint32_t cpu : ParseHostList(str, name)) {
+            if (cpu >= hostCpus || cpu >= CPU_SETSIZE) panic("sim.hostPlacement.%s: CPU %d does not exist (%d host CPUs)", name, cpu, hostCpus);
+            cpus.push_back(cpu);
+        }
+    };
+    auto readPinning = [&](const char* name) {
+        std::string pinning = config.get<const char*>(std::string("sim.hostPlacement.") + name, "thread");
+        if (pinning != "thread" && pinning != "set") panic("Invalid sim.hostPlacement.%s %s (thread/set)", name, pinning.c_str());
+        return pinning == "thread";
+    };
+    readCpus("appCpus", appCpus);
+    readCpus("simCpus", simCpus);
+    appPerThread = readPinning("appPinning");
+    simPerThread = readPinning("simPinning");
+    appTicket = 0;
+
+    //Host topology
+    cpuNodes.resize(hostCpus, -1);
+    numNodes = 0;
+    uint64_t allNodes = 0;
+    for (uint32_t node : ParseHostList(ReadSysFile("/sys/devices/system/node/online"), "node")) {
+        if (node >= MAX_HOST_NODES) {
+            warn("Host node %d ignored, only %d nodes supported", node, MAX_HOST_NODES);
+            continue;
+        }
+        std::stringstream ss;
+        ss << "/sys/devices/system/node/node" << node << "/cpulist";
+        for (uint32_t cpu : ParseHostList(ReadSysFile(ss.str()), "CPU")) {
+            if (cpu < hostCpus) cpuNodes[cpu] = node;
+        }
+        allNodes |= 1ul << node;
+        numNodes++;
+    }
+
+    //With a single node (or no NUMA info), there is nothing to place
+    numaEnabled = numNodes > 1;
+
+    std::string heapPolicy = config.get<const char*>("sim.hostPlacement.heapPolicy", "firstTouch");
+    if (heapPolicy == "interleave") {
+        if (numaEnabled) {
+            const void* base;
+            size_t size;
+            gm_segment_bounds(&base, &size);
+            if (setPolicy(base, size, MPOL_INTERLEAVE, allNodes, "global heap")) info("Interleaving global heap across %d host nodes", numNodes);
+        } else {
+            warn("sim.hostPlacement.heapPolicy = interleave, but the host has a single NUMA node");
+        }
+    } else if (heapPolicy != "firstTouch") {
+        panic("Invalid sim.hostPlacement.heapPolicy %s (firstTouch/interleave)", heapPolicy.c_str());
+    }
+
+    info("Host placement: %ld app CPUs (%s), %ld contention sim CPUs (%s), %d nodes", appCpus.size(),
+         appPerThread? "per thread" : "shared", simCpus.size(), simPerThread? "per thread" : "shared", numNodes);
+}
+
+void HostPlacement::pin(const g_vector<uint32_t>& cpus, bool perThread, uint32_t idx, const char* kind) {
+    if (cpus.empty()) return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (perThread) {
+        CPU_SET(cpus[idx % cpus.size()], &cpuset);
+    } else {
+        for (uint32_t cpu : cpus) CPU_SET(cpu, &cpuset);
+    }
+    //0 is the calling thread (not the whole process)
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        warn("Could not pin %s thread %d: %s", kind, idx, strerror(errno));
+    }
+}
+
+void HostPlacement::pinAppThread() {
+    if (appCpus.empty()) return;
+    pin(appCpus, appPerThread, __sync_fetch_and_add(&appTicket, 1), "application");
+}
+
+void HostPlacement::pinSimThread(uint32_t thid) {
+    pin(simCpus, simPerThread, thid, "contention");
+}
+
+int32_t HostPlacement::getSimThreadNode(uint32_t thid) const {
+    if (simCpus.empty()) return -1;
+    if (simPerThread) return cpuNodes[simCpus[thid % simCpus.size()]];
+    int32_t node = cpuNodes[simCpus[0]];
+    for (uint32_t cpu : simCpus) {
+        if (cpuNodes[cpu] != node) return -1;
+    }
+    return node;
+}
+
+void HostPlacement::bindToNode(const void* ptr, size_t bytes, int32_t node) {
+    if (node < 0 || !numaEnabled) return;
+    //Only bind pages fully within the range, as the rest may belong to others
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)ptr + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)ptr + bytes) & ~(pageSize - 1);
+    if (start >= end) return;
+    setPolicy((const void*)start, end - start, MPOL_PREFERRED, 1ul << node, "domain state");
+}
+
+bool HostPlacement::setPolicy(const void* ptr, size_t bytes, int mode, uint64_t nodeMask, const char* what) {
+    if (!numaEnabled) return false;
+    //MPOL_MF_MOVE also migrates pages that were touched already (e.g., during initialization)
+    long r = syscall(SYS_mbind, ptr, bytes, mode, &nodeMask, MAX_HOST_NODES + 1, MPOL_MF_MOVE);
+    if (r != 0) {
+        warn("mbind of %s failed (%s), not applying any more NUMA policies", what, strerror(errno));
+        numaEnabled = false;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_PLACEMENT_H_
+#define HOST_PLACEMENT_H_
+
+#include <stdint.h>
+#include <string>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+
+class Config;
+
+//Alignment for state that is bound to a host node, so it does not share pages with other state
+#define HOST_PAGE_ALIGN 4096
+
+//Rounds bytes up to whole pages
+inline size_t hostPageBytes(size_t bytes) {
+    return (bytes + HOST_PAGE_ALIGN - 1) & ~((size_t)HOST_PAGE_ALIGN - 1);
+}
+
+//Allocates objs Ts on pages of their own, so that binding hostPageBytes(sizeof(T)*objs) moves nothing else
+template <typename T> T* gm_page_alloc(size_t objs = 1) {
+    return reinterpret_cast<T*>(gm_memalign<char>(HOST_PAGE_ALIGN, hostPageBytes(sizeof(T)*objs)));
+}
+
+/* Places zsim's own threads and memory on the host machine.
+ *
+ * AFFINITY: appCpus and simCpus are host CPU lists ("0-7,16-23"). Application
+ * threads (the ones that run the simulated cores) are restricted to appCpus,
+ * and contention simulation threads to simCpus. With the "thread" pinning mode,
+ * each thread is pinned to a single CPU of its list, round-robin (application
+ * threads in start order, contention threads by index); with "set", threads can
+ * use any CPU of the list. Empty lists (the default) leave threads unpinned.
+ *
+ * NUMA: With heapPolicy = "firstTouch" (the default), each page of the global
+ * heap lands on the node of the thread that first touches it; with
+ * "interleave", heap pages are interleaved across all nodes. Either way, when
+ * a contention thread's CPUs are all on one node, the state of the domains it
+ * simulates (its DomainData, and large memory-model structures registered by
+ * their owners) is bound to that node. Policies are set with mbind on the
+ * shared heap segment, so they apply to every process.
+ */
+class HostPlacement : public GlobAlloc {
+    private:
+        g_vector<uint32_t> appCpus;
+        g_vector<uint32_t> simCpus;
+        bool appPerThread;
+        bool simPerThread;
+        volatile uint32_t appTicket; //next application thread, for round-robin pinning
+
+        g_vector<int32_t> cpuNodes; //host node of each CPU, -1 if unknown
+        uint32_t numNodes;
+        bool numaEnabled; //cleared if mbind fails (e.g., no NUMA support)
+
+    public:
+        explicit HostPlacement(Config& config);
+
+        //Called by each thread as it starts; no-ops without a CPU list
+        void pinAppThread();
+        void pinSimThread(uint32_t thid);
+
+        //Node contention thread thid always runs on, or -1 if it can run on several
+        int32_t getSimThreadNode(uint32_t thid) const;
+
+        //Binds the whole pages within [ptr, ptr+bytes) to node; no-op if node is -1
+        void bindToNode(const void* ptr, size_t bytes, int32_t node);
+
+    private:
+        void pin(const g_vector<uint32_t>& cpus, bool perThread, uint32_t idx, const char* kind);
+        bool setPolicy(const void* ptr, size_t bytes, int mode, uint64_t nodeMask, const char* what);
+};
+
+#endif  // HOST_PLACEMENT_H_
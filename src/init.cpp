@@ -46,14 +46,17 @@
 #include "filter_cache.h"
 #include "galloc.h"
 #include "hash.h"
+#include "host_placement.h"
 #include "ideal_arrays.h"
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "multi_channel_mem.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
 #include "part_repl_policies.h"
+#include "phase_ctrl.h"
 #include "pin_cmd.h"
 #include "prefetcher.h"
 #include "proc_stats.h"
@@ -301,26 +304,11 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
 // NOTE: frequency is SYSTEM frequency; mem freq specified in tech
 DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
-    uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
-    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
-    uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
-    const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
-    const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
-
-    // If set, writes are deferred and bursted out to reduce WTR overheads
-    bool deferWrites = config.get<bool>(prefix + "deferWrites", true);
-    bool closedPage = config.get<bool>(prefix + "closedPage", true);
-
-    // Max row hits before we stop prioritizing further row hits to this bank.
-    // Balances throughput and fairness; 0 -> FCFS / high (e.g., -1) -> pure FR-FCFS
-    uint32_t maxRowHits = config.get<uint32_t>(prefix + "maxRowHits", 4);
-
-    // Request queues
-    uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
-    uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
-
-    auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
-            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+    DDRMemoryConfig cfg(config, prefix);
+    auto mem = new (gm_page_alloc<DDRMemory>()) DDRMemory(zinfo->lineSize, cfg.pageSize, cfg.ranksPerChannel, cfg.banksPerRank, frequency, cfg.tech,
+            cfg.addrMapping, cfg.controllerLatency, cfg.queueDepth, cfg.maxRowHits, cfg.deferWrites, cfg.closedPage, domain, name);
+    mem->setPolicies(cfg);
+    mem->placeOnDomainNode();
     return mem;
 }
 
@@ -512,12 +500,14 @@ static void InitSystem(Config& config) {
         //uint32_t domain = nextDomain(); //i*zinfo->numDomains/memControllers;
         uint32_t domain = i*zinfo->numDomains/memControllers;
         mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
+        MemoryController* mc = dynamic_cast<MemoryController*>(mems[i]);
+        if (mc && zinfo->phaseCtrl) zinfo->phaseCtrl->addMemController(mc);
     }
 
     if (memControllers > 1) {
         bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
         if (splitAddrs) {
-            MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter", config);
+            MemObject* splitter = new MultiChannelMemory(mems, "mem-splitter", config, "sys.mem.");
             mems.resize(1);
             mems[0] = splitter;
         }
@@ -695,12 +685,14 @@ static void InitSystem(Config& config) {
                         TimingCore* tcore = new (&timingCores[j]) TimingCore(ic, dc, domain, name);
                         zinfo->eventRecorders[coreIdx] = tcore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
+                        zinfo->contentionSim->registerCore(tcore);
                         core = tcore;
                     } else {
                         assert(type == "OOO");
                         OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
+                        zinfo->contentionSim->registerCore(ocore);
                         core = ocore;
                     }
                     coreMap[group].push_back(core);
@@ -838,7 +830,7 @@ static void PostInitStats(bool perProcessDir, Config& config) {
                 zinfo->trigger = i;
                 zinfo->eventualStatsBackend->dump(true /*buffered*/);
             };
-            zinfo->eventQueue->insert(makeAdaptiveEvent(getInstrs, dumpStats, 0, zinfo->maxMinInstrs, MAX_IPC*zinfo->phaseLength));
+            zinfo->eventQueue->insert(makeAdaptiveEvent(getInstrs, dumpStats, 0, zinfo->maxMinInstrs, MAX_IPC*zinfo->maxPhaseLength));
         }
     }
 
@@ -862,6 +854,26 @@ static void InitGlobalStats() {
     ProxyStat* phaseStat = new ProxyStat();
     phaseStat->init("phase", "Simulated phases", &zinfo->numPhases);
     zinfo->rootStat->append(phaseStat);
+
+    //Global heap (galloc) counters, shared by all processes
+    AggregateStat* heapStat = new AggregateStat();
+    heapStat->init("heap", "Global heap stats");
+    auto heapCounter = [heapStat](const char* name, const char* desc, uint64_t gm_counters::* field) {
+        auto get = [field]() { gm_counters c; gm_get_counters(&c); return c.*field; };
+        LambdaStat<decltype(get)>* stat = new LambdaStat<decltype(get)>(get);
+        stat->init(name, desc);
+        heapStat->append(stat);
+    };
+    heapCounter("smallAllocs", "Allocations served by the per-CPU arenas", &gm_counters::smallAllocs);
+    heapCounter("contended", "Arena allocations that waited for the arena's lock", &gm_counters::contended);
+    heapCounter("slabs", "Slabs the arenas took from the shared heap", &gm_counters::slabs);
+    heapCounter("largeAllocs", "Allocations served by the shared heap, under its lock", &gm_counters::largeAllocs);
+    heapCounter("tlbMisses", "Host dTLB load misses of all simulator processes (sampled by the harness)", &gm_counters::hostTlbMisses);
+    auto hugePages = []() { gm_counters c; gm_get_counters(&c); return (uint64_t)c.hugePages; };
+    LambdaStat<decltype(hugePages)>* hugeStat = new LambdaStat<decltype(hugePages)>(hugePages);
+    hugeStat->init("hugePages", "Huge page backing of the heap (0: none, 1: THP, 2: hugetlbfs)");
+    heapStat->append(hugeStat);
+    zinfo->rootStat->append(heapStat);
 }
 
 
@@ -906,6 +918,7 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     }
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
+    zinfo->hostPlacement = new HostPlacement(config); //before contention threads start and domain state is allocated
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
     zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
     zinfo->contentionSim->initStats(zinfo->rootStat);
@@ -917,11 +930,21 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     zinfo->numPhases = 0;
 
     zinfo->phaseLength = config.get<uint32_t>("sim.phaseLength", 10000);
+    zinfo->nextPhaseLength = zinfo->phaseLength;
+    zinfo->maxPhaseLength = zinfo->phaseLength;
+    zinfo->phaseCtrl = nullptr;
+    if (config.get<bool>("sim.adaptivePhase.enable", false)) {
+        zinfo->phaseCtrl = new PhaseLengthController(config, zinfo->phaseLength);
+        zinfo->phaseCtrl->initStats(zinfo->rootStat);
+        zinfo->maxPhaseLength = zinfo->phaseCtrl->getMaxLength();
+    }
+    zinfo->seed = config.get<uint64_t>("sim.seed", 0x5eed);
     zinfo->statsPhaseInterval = config.get<uint32_t>("sim.statsPhaseInterval", 100);
     zinfo->freqMHz = config.get<uint32_t>("sys.frequency", 2000);
 
     //Maxima/termination conditions
     zinfo->maxPhases = config.get<uint64_t>("sim.maxPhases", 0);
+    if (zinfo->maxPhases && zinfo->phaseCtrl) warn("sim.maxPhases with adaptive phase lengths does not bound simulated cycles");
     zinfo->maxMinInstrs = config.get<uint64_t>("sim.maxMinInstrs", 0);
     zinfo->maxTotalInstrs = config.get<uint64_t>("sim.maxTotalInstrs", 0);
 
@@ -951,7 +974,17 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
         assert(parallelism > 0); //jeez...
 
         uint32_t schedQuantum = config.get<uint32_t>("sim.schedQuantum", 10000); //phases
-        zinfo->sched = new Scheduler(EndOfPhaseActions, parallelism, zinfo->numCores, schedQuantum);
+
+        //Barrier wakeups: flat (the waker wakes every thread) or tree (woken threads wake others)
+        string barrier = config.get<const char*>("sim.barrier", "flat");
+        uint32_t barrierFanout = 0;
+        if (barrier == "tree") {
+            barrierFanout = config.get<uint32_t>("sim.barrierFanout", 4);
+            if (barrierFanout == 0) panic("sim.barrierFanout must be non-zero");
+        } else if (barrier != "flat") {
+            panic("Invalid sim.barrier %s (flat/tree)", barrier.c_str());
+        }
+        zinfo->sched = new Scheduler(EndOfPhaseActions, parallelism, zinfo->numCores, schedQuantum, barrierFanout);
     } else {
         zinfo->sched = nullptr;
     }
@@ -1017,6 +1050,9 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
     //HACK: Read all variables that are read in the harness but not in init
     //This avoids warnings on those elements
     config.get<uint32_t>("sim.gmMBytes", (1 << 10));
+    config.get<uint32_t>("sim.gmArenas", sysconf(_SC_NPROCESSORS_ONLN));
+    config.get<bool>("sim.gmHugePages", false);
+    config.get<bool>("sim.countTlbMisses", true);
     if (!zinfo->attachDebugger) config.get<bool>("sim.deadlockDetection", true);
     config.get<bool>("sim.aslr", false);
 
@@ -1,12 +1,12 @@
 #include "line_placement.h"
 #include "mc.h"
-#include <stdlib.h>
 
 void
-LinePlacementPolicy::initialize(Config & config)
+LinePlacementPolicy::initialize(Config & config, uint64_t seed)
 {
-   srand48_r(rand(), &_buffer);
+   _rng.init(seed);
    _sample_rate = config.get<double>("sys.mem.mcdram.sampleRate");
+   _sample_threshold = Rng::sampleThreshold(_sample_rate);
    _enable_replace = config.get<bool>("sys.mem.mcdram.enableReplace", true); 
 }
 
@@ -17,7 +17,5 @@ LinePlacementPolicy::handleCacheMiss(Way * current_tad)
 		return true;
 	if (!_enable_replace)
 		return false;
-	double f;
-    drand48_r(&_buffer, &f);
-    return f < _sample_rate;
+	return _rng.sample(_sample_threshold);
 }
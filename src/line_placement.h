@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "memory_hierarchy.h"
+#include "rng.h"
 
 using namespace std;
 
@@ -12,11 +13,12 @@ class LinePlacementPolicy
 {
 public:
    LinePlacementPolicy() {}; 
-   void initialize(Config & config);
+   void initialize(Config & config, uint64_t seed);
    bool handleCacheMiss(Way * current_tad);
    
 private:
-   drand48_data _buffer;
+   Rng _rng;
    double _sample_rate;
+   uint64_t _sample_threshold;
    bool _enable_replace;
 };
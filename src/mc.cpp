@@ -5,6 +5,12 @@
 #include "mem_ctrls.h"
 #include "dramsim_mem_ctrl.h"
 #include "ddr_mem.h"
+#include "multi_channel_mem.h"
+#include "dram_cache_profiler.h"
+#include "dram_cache_layout.h"
+#include "host_placement.h"
+#include "event_recorder.h"
+#include "timing_event.h"
 #include "zsim.h"
 
 MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t domain, Config& config)
@@ -24,6 +30,12 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 	}
 	_sram_tag = config.get<bool>("sys.mem.sram_tag", false);
 	_llc_latency = config.get<uint32_t>("sys.caches.l3.latency");
+	_weave_timing = config.get<bool>("sys.mem.weaveTiming", false);
+	_dag_rec = nullptr;
+	_dag_start = nullptr;
+	_dag_start_cycle = 0;
+	_dag_tail = {nullptr, 0};
+	_dag_last = {nullptr, 0};
 	double timing_scale = config.get<double>("sys.mem.dram_timing_scale", 1);
 	g_string scheme = config.get<const char *>("sys.mem.cache_scheme", "NoCache");
 	_ext_type = config.get<const char *>("sys.mem.ext_dram.type", "Simple");
@@ -46,6 +58,11 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		assert(_granularity == 4096);
 		assert(_num_ways == _cache_size / _granularity);
 		_scheme = HMA;
+		// Remap epoch, in memory requests
+		_os_quantum = config.get<uint32_t>("sys.mem.mcdram.os_quantum", 100000);
+		// OS time to remap a page (page table update, TLB shootdown), 
+		// charged to the request that triggers the remap. 0 disables it.
+		_os_stall_per_page = config.get<uint32_t>("sys.mem.mcdram.os_stall_per_page", 0);
 	} else if (scheme == "HybridCache") {
 		// 4KB page or 2MB page
 		assert(_granularity == 4096 || _granularity == 4096 * 512); 
@@ -70,14 +87,34 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 	if (_bw_balance)
 		assert(_scheme == AlloyCache || _scheme == HybridCache);
 
+	// Weave-phase domains of the DRAM channels (sys.mem.channelDomains).
+	// "controller" keeps them all in the controller's domain. "spread"
+	// spreads the ext channel (0) and the mcdram channels (1..n) over the
+	// controller's share of the domains, so that contention threads can
+	// simulate them in parallel; crossings link them to the rest of the DAG.
+	g_string placement = config.get<const char *>("sys.mem.channelDomains", "controller");
+	uint32_t domain_share = 1;
+	if (placement == "spread") {
+		uint32_t controllers = config.get<uint32_t>("sys.mem.controllers", 1);
+		domain_share = std::max(1u, zinfo->numDomains / controllers);
+	} else if (placement != "controller")
+		panic("Invalid sys.mem.channelDomains %s (controller/spread)", placement.c_str());
+	uint32_t num_channels = 1;
+	if (scheme != "NoCache")
+		num_channels += config.get<uint32_t>("sys.mem.mcdram.mcdramPerMC", 4) * config.get<uint32_t>("sys.mem.mcdram.pseudoChannels", 1);
+	auto channel_domain = [&](uint32_t channel) { return domain + channel * domain_share / num_channels; };
+
 	// Configure the external Dram
 	g_string ext_dram_name = _name + g_string("-ext");
 	if (_ext_type == "Simple") {
     	uint32_t latency = config.get<uint32_t>("sys.mem.ext_dram.latency", 100);
         _ext_dram = (SimpleMemory *) gm_malloc(sizeof(SimpleMemory));
 		new (_ext_dram)	SimpleMemory(latency, ext_dram_name, config);
-	} else if (_ext_type == "DDR")
-        _ext_dram = BuildDDRMemory(config, frequency, domain, ext_dram_name, "sys.mem.ext_dram.", 4, 1.0);
+	} else if (_ext_type == "DDR") {
+        DDRMemory * ddr = BuildDDRMemory(config, frequency, channel_domain(0), ext_dram_name, "sys.mem.ext_dram.", 0, 1.0);
+		_ext_ddrs.push_back(ddr);
+        _ext_dram = ddr;
+	}
 	else if (_ext_type == "MD1") {
     	uint32_t latency = config.get<uint32_t>("sys.mem.ext_dram.latency", 100);
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.ext_dram.bandwidth", 6400);
@@ -93,31 +130,35 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		traceName += "_ext";
         _ext_dram = (DRAMSimMemory *) gm_malloc(sizeof(DRAMSimMemory));
     	uint32_t latency = config.get<uint32_t>("sys.mem.ext_dram.latency", 100);
-		new (_ext_dram) DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
+		new (_ext_dram) DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, channel_domain(0), name);
 	} else 
         panic("Invalid memory controller type %s", _ext_type.c_str());
 
 	if (_scheme != NoCache) {		
 		// Configure the MC-Dram (Timing Model)
 		_mcdram_per_mc = config.get<uint32_t>("sys.mem.mcdram.mcdramPerMC", 4);
-		//_mcdram = new MemObject * [_mcdram_per_mc];
-		_mcdram = (MemObject **) gm_malloc(sizeof(MemObject *) * _mcdram_per_mc);
+		// HBM2 pseudo-channel mode: each channel is modeled as this many
+		// independent controllers (use a -PC tech, see ddr_mem.cpp)
+		_mcdram_per_mc *= config.get<uint32_t>("sys.mem.mcdram.pseudoChannels", 1);
+		g_vector<MemObject*> channels(_mcdram_per_mc);
 		for (uint32_t i = 0; i < _mcdram_per_mc; i++) {
 			g_string mcdram_name = _name + g_string("-mc-") + g_string(to_string(i).c_str());
     	    //g_string mcdram_name(ss.str().c_str());
 			if (_mcdram_type == "Simple") {
 	    		uint32_t latency = config.get<uint32_t>("sys.mem.mcdram.latency", 50);
-				_mcdram[i] = (SimpleMemory *) gm_malloc(sizeof(SimpleMemory));
-				new (_mcdram[i]) SimpleMemory(latency, mcdram_name, config);
-	        	//_mcdram[i] = new SimpleMemory(latency, mcdram_name, config);
+				channels[i] = (SimpleMemory *) gm_malloc(sizeof(SimpleMemory));
+				new (channels[i]) SimpleMemory(latency, mcdram_name, config);
+	        	//channels[i] = new SimpleMemory(latency, mcdram_name, config);
 			} else if (_mcdram_type == "DDR") {
-				// XXX HACK tBL for mcdram is 1, so for data access, should multiply by 2, for tad access, should multiply by 3. 
-        		_mcdram[i] = BuildDDRMemory(config, frequency, domain, mcdram_name, "sys.mem.mcdram.", 4, timing_scale);
+				// Burst length and bus width come from the tech (e.g., HBM2-2000)
+				DDRMemory * ddr = BuildDDRMemory(config, frequency, channel_domain(i + 1), mcdram_name, "sys.mem.mcdram.", 0, timing_scale);
+				_mcdram_ddrs.push_back(ddr);
+        		channels[i] = ddr;
 			} else if (_mcdram_type == "MD1") {
 				uint32_t latency = config.get<uint32_t>("sys.mem.mcdram.latency", 50);
         		uint32_t bandwidth = config.get<uint32_t>("sys.mem.mcdram.bandwidth", 12800);
-        		_mcdram[i] = (MD1Memory *) gm_malloc(sizeof(MD1Memory));
-				new (_mcdram[i]) MD1Memory(64, frequency, bandwidth, latency, mcdram_name);
+        		channels[i] = (MD1Memory *) gm_malloc(sizeof(MD1Memory));
+				new (channels[i]) MD1Memory(64, frequency, bandwidth, latency, mcdram_name);
 		    } else if (_mcdram_type == "DRAMSim") {
 			    uint64_t cpuFreqHz = 1000000 * frequency;
 		        uint32_t capacity = config.get<uint32_t>("sys.mem.capacityMB", 16384);
@@ -127,40 +168,59 @@ MemoryController::MemoryController(g_string& name, uint32_t frequency, uint32_t
 		        string traceName = config.get<const char*>("sys.mem.traceName");
 				traceName += "_mc";
 				traceName += to_string(i);
-		        _mcdram[i] = (DRAMSimMemory *) gm_malloc(sizeof(DRAMSimMemory));
+		        channels[i] = (DRAMSimMemory *) gm_malloc(sizeof(DRAMSimMemory));
     			uint32_t latency = config.get<uint32_t>("sys.mem.mcdram.latency", 50);
-				new (_mcdram[i]) DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, domain, name);
+				new (channels[i]) DRAMSimMemory(dramTechIni, dramSystemIni, outputDir, traceName, capacity, cpuFreqHz, latency, channel_domain(i + 1), name);
 			} else 
     	     	panic("Invalid memory controller type %s", _mcdram_type.c_str());
 		}
+		if (domain_share > 1)
+			info("%s: ext DRAM in domain %d, %d mcdram channels in domains %d-%d", _name.c_str(), channel_domain(0),
+					_mcdram_per_mc, channel_domain(1), channel_domain(_mcdram_per_mc));
+		// Channel interleaving and striping of page fills (sys.mem.mcdram.mapGranu, channelHash, stripeBulk)
+		g_string mcdram_name = _name + g_string("-mcdram");
+		_mcdram = gm_page_alloc<MultiChannelMemory>();
+		new (_mcdram) MultiChannelMemory(channels, mcdram_name.c_str(), config, "sys.mem.mcdram.");
+		_mcdram->placeOnDomainNode(channel_domain(1));
+
 		// Configure MC-Dram Functional Model
 		_num_sets = _cache_size / _num_ways / _granularity;
 		if (_scheme == Tagless)
 			assert(_num_sets == 1);
 		_cache = (Set *) gm_malloc(sizeof(Set) * _num_sets);
-		for (uint64_t i = 0; i < _num_sets; i ++) {
-			_cache[i].ways = (Way *) gm_malloc(sizeof(Way) * _num_ways);
-			_cache[i].num_ways = _num_ways;
-			for (uint32_t j = 0; j < _num_ways; j++)
-	   			_cache[i].ways[j].valid = false;
-		}
+		// Where each set's tags, counters and ways live in mcdram (sys.mem.mcdram.layout)
+		_layout = new DramCacheLayout(config, _num_ways, _granularity / 64, _scheme == AlloyCache);
 		if (_scheme == AlloyCache) {
 			_line_placement_policy = (LinePlacementPolicy *) gm_malloc(sizeof(LinePlacementPolicy));
 			new (_line_placement_policy) LinePlacementPolicy();
-   			_line_placement_policy->initialize(config);
+   			_line_placement_policy->initialize(config, DeriveSeed(zinfo->seed, (_name + "-line-placement").c_str()));
 		} else if (_scheme == HMA) {
 			_os_placement_policy = (OSPlacementPolicy *) gm_malloc(sizeof(OSPlacementPolicy));
 			new (_os_placement_policy) OSPlacementPolicy(this);
 		} else if (_scheme == UnisonCache || _scheme == HybridCache ){
+			// The page placement policy allocates each set's ways next to the 
+			// set's replacement metadata.
 			_page_placement_policy = (PagePlacementPolicy *) gm_malloc(sizeof(PagePlacementPolicy));
 			new (_page_placement_policy) PagePlacementPolicy(this);
-		  		_page_placement_policy->initialize(config);
+		  		_page_placement_policy->initialize(config, DeriveSeed(zinfo->seed, (_name + "-page-placement").c_str()));
+		}
+		for (uint64_t i = 0; i < _num_sets; i ++) {
+			if (_scheme != UnisonCache && _scheme != HybridCache)
+				_cache[i].ways = (Way *) gm_malloc(sizeof(Way) * _num_ways);
+			_cache[i].num_ways = _num_ways;
+			for (uint32_t j = 0; j < _num_ways; j++)
+	   			_cache[i].ways[j].valid = false;
 		}
 	}
 	if (_scheme == HybridCache) {
 		_tag_buffer = (TagBuffer *) gm_malloc(sizeof(TagBuffer));	
 		new (_tag_buffer) TagBuffer(config);
 	}
+	if (_scheme == NoCache)
+		_layout = nullptr;
+	_profiler = nullptr;
+	if (config.get<bool>("sys.mem.profiler.enable", false) && _scheme != NoCache && _scheme != CacheOnly)
+		_profiler = new DramCacheProfiler(config, _name, _num_sets);
  	// Stats
    _num_hit_per_step = 0;
    _num_miss_per_step = 0;
@@ -206,6 +266,13 @@ MemoryController::access(MemReq& req)
     }
 
 	_num_requests ++;
+	if (_weave_timing) {
+		_dag_rec = zinfo->eventRecorders[req.srcId];
+		_dag_start = nullptr;
+		_dag_start_cycle = req.cycle;
+		_dag_tail = {nullptr, req.cycle};
+		_dag_last = {nullptr, req.cycle};
+	}
 	if (_scheme == NoCache) {
 		///////   load from external dram
  		req.cycle = _ext_dram->access(req, 0, 4);
@@ -221,9 +288,6 @@ MemoryController::access(MemReq& req)
 	
 	ReqType type = (req.type == GETS || req.type == GETX)? LOAD : STORE;
 	Address address = req.lineAddr;
-	uint32_t mcdram_select = (address / 64) % _mcdram_per_mc;
-	Address mc_address = (address / 64 / _mcdram_per_mc * 64) | (address % 64); 
-	//printf("address=%ld, _mcdram_per_mc=%d, mc_address=%ld\n", address, _mcdram_per_mc, mc_address);
 	Address tag = address / (_granularity / 64);
 	uint64_t set_num = tag % _num_sets;
 	uint32_t hit_way = _num_ways;
@@ -233,9 +297,7 @@ MemoryController::access(MemReq& req)
 
 	if (_scheme == CacheOnly) {
 		///////   load from mcdram
-		req.lineAddr = mc_address;
- 		req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
-		req.lineAddr = address;
+ 		req.cycle = _mcdram->access(req, 0, 4);
 		_numLoadHit.inc();
 		futex_unlock(&_lock);
 		return req.cycle;
@@ -246,11 +308,14 @@ MemoryController::access(MemReq& req)
 	// whether needs to probe tag for HybridCache.
 	// need to do so for LLC dirty eviction and if the page is not in TB  
 	bool hybrid_tag_probe = false; 
+	TLBEntry * page = nullptr;
 	if (_granularity >= 4096) {
-		if (_tlb.find(tag) == _tlb.end())
-         	_tlb[tag] = TLBEntry {tag, _num_ways, 0, 0, 0};
-		if (_tlb[tag].way != _num_ways) {
-			hit_way = _tlb[tag].way;
+		auto tlb_it = _tlb.find(tag);
+		if (tlb_it == _tlb.end())
+         	tlb_it = _tlb.insert(std::make_pair(tag, TLBEntry {tag, _num_ways, 0, 0, 0})).first;
+		page = &tlb_it->second;
+		if (page->way != _num_ways) {
+			hit_way = page->way;
 			assert(_cache[set_num].ways[hit_way].valid && _cache[set_num].ways[hit_way].tag == tag);
 		} else if (_scheme != Tagless) {
 			// for Tagless, this assertion takes too much time.
@@ -261,15 +326,15 @@ MemoryController::access(MemReq& req)
 		if (_scheme == UnisonCache) {
 			//// Tag and data access. For simplicity, use a single access.  
 			if (type == LOAD) {
-				req.lineAddr = mc_address; //transMCAddressPage(set_num, 0); //mc_address;
-				req.cycle = _mcdram[mcdram_select]->access(req, 0, 6);
+				// Tags are read with the data of the predicted way (way 0 on a miss)
+				uint32_t read_way = (hit_way == _num_ways)? 0 : hit_way;
+				req.cycle = mcdramAccess(req, _layout->dataLine(set_num, read_way, address), MemReq::DRAMCACHE_TAG, 0, 6);
 				_mc_bw_per_step += 6;
 				_numTagLoad.inc();
-				req.lineAddr = address;
 			} else {
 				assert(type == STORE);
-	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+	            MemReq tag_probe = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				req.cycle = mcdramAccess(tag_probe, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 0, 2);
 				_mc_bw_per_step += 2;
 				_numTagLoad.inc();
 			}
@@ -296,24 +361,22 @@ MemoryController::access(MemReq& req)
 			if (_sram_tag) {
 				req.cycle += _llc_latency; 
 /*				if (hit_way == 0) {
-					req.lineAddr = mc_address; 
-					req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
+					req.cycle = _mcdram->access(req, 0, 4);
 					_mc_bw_per_step += 4;
 					_numTagLoad.inc();
-					req.lineAddr = address;
 				}
 */
 			} else { 
-				req.lineAddr = mc_address; 
-				req.cycle = _mcdram[mcdram_select]->access(req, 0, 6);
+				req.cycle = mcdramAccess(req, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 0, 6);
 				_mc_bw_per_step += 6;
 				_numTagLoad.inc();
-				req.lineAddr = address;
 			}
 			///////////////////////////////
 		}
    	}
 	bool cache_hit = hit_way != _num_ways;
+	if (_profiler)
+		_profiler->recordAccess(set_num, tag, cache_hit, req.cycle);
 	
 	//orig_cycle = req.cycle; 
 	// dram cache logic. Here, I'm assuming the 4 mcdram channels are 
@@ -323,6 +386,8 @@ MemoryController::access(MemReq& req)
 	if (!cache_hit)
 	{
 		uint64_t cur_cycle = req.cycle;
+		// Evictions start once the lookup is done, not after the miss is served
+		DagNode lookup = _dag_tail;
 		_num_miss_per_step ++;
 		if (type == LOAD)
 			_numLoadMiss.inc();
@@ -336,7 +401,7 @@ MemoryController::access(MemReq& req)
 	         	place = _line_placement_policy->handleCacheMiss(&_cache[set_num].ways[0]);
          	replace_way = place? 0 : 1;
       	} else if (_scheme == HMA)
-         	_os_placement_policy->handleCacheAccess(tag, type);
+         	_os_placement_policy->handleCacheAccess(page, type);
       	else if (_scheme == Tagless) {
 			replace_way = _next_evict_idx;
 			_next_evict_idx = (_next_evict_idx + 1) % _num_ways;
@@ -350,52 +415,52 @@ MemoryController::access(MemReq& req)
 		if (_scheme == AlloyCache) {
 			if (type == LOAD) {
 				if (!_sram_tag && set_num >= _ds_index)
-					req.cycle = _ext_dram->access(req, 1, 4);
+					req.cycle = memAccess(_ext_dram, req, 1, 4);
 				else 
-					req.cycle = _ext_dram->access(req, 0, 4);
+					req.cycle = memAccess(_ext_dram, req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			} else if (type == STORE && replace_way >= _num_ways) {
 				// no replacement
-				req.cycle = _ext_dram->access(req, 0, 4);
+				req.cycle = memAccess(_ext_dram, req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			} else if (type == STORE) { // && replace_way < _num_ways)
 	            MemReq load_req = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _ext_dram->access(load_req, 0, 4);
+				req.cycle = memAccess(_ext_dram, load_req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			}
 		} else if (_scheme == HMA) { 
-			req.cycle = _ext_dram->access(req, 0, 4);
+			req.cycle = memAccess(_ext_dram, req, 0, 4);
 			_ext_bw_per_step += 4;
 			data_ready_cycle = req.cycle;
 		} else if (_scheme == UnisonCache) {
 			if (type == LOAD) {
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = memAccess(_ext_dram, req, 1, 4);
 				_ext_bw_per_step += 4;
 			} else if (type == STORE && replace_way >= _num_ways) { 
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = memAccess(_ext_dram, req, 1, 4);
 				_ext_bw_per_step += 4;
 			}
 			data_ready_cycle = req.cycle;
 		} else if (_scheme == HybridCache) {
 			if (hybrid_tag_probe) {
-		        MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+		        MemReq tag_probe = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				req.cycle = mcdramAccess(tag_probe, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 0, 2);
 				_mc_bw_per_step += 2;
-				req.cycle = _ext_dram->access(req, 1, 4);
+				req.cycle = memAccess(_ext_dram, req, 1, 4);
 				_ext_bw_per_step += 4;
 				_numTagLoad.inc();
 				data_ready_cycle = req.cycle;
 			} else {
-				req.cycle = _ext_dram->access(req, 0, 4);
+				req.cycle = memAccess(_ext_dram, req, 0, 4);
 				_ext_bw_per_step += 4;
 				data_ready_cycle = req.cycle;
 			}
 		} else if (_scheme == Tagless) {
 			assert(_ext_dram);
-			req.cycle = _ext_dram->access(req, 0, 4);
+			req.cycle = memAccess(_ext_dram, req, 0, 4);
 			_ext_bw_per_step += 4;
 			data_ready_cycle = req.cycle;
 		}
@@ -406,29 +471,31 @@ MemoryController::access(MemReq& req)
 			///// mcdram replacement 
 			// TODO update the address 
 			if (_scheme == AlloyCache) { 
-	            MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+	            MemReq insert_req = {address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 				uint32_t size = _sram_tag? 4 : 6;
-				_mcdram[mcdram_select]->access(insert_req, 2, size);
+				data_ready_cycle = std::max(data_ready_cycle, mcdramPostWrite(insert_req, _layout->dataLine(set_num, replace_way, address), MemReq::DRAMCACHE_FILL, size));
 				_mc_bw_per_step += size;
 				_numTagStore.inc();
 			} else if (_scheme == UnisonCache || _scheme == HybridCache || _scheme == Tagless) {
 				uint32_t access_size = (_scheme == UnisonCache || _scheme == Tagless)? _footprint_size : (_granularity / 64); 
 				// load page from ext dram
 		        MemReq load_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				_ext_dram->access(load_req, 2, access_size*4);
+				memAccess(_ext_dram, load_req, 2, access_size*4);
+				DagNode page_load = _dag_last;
 				_ext_bw_per_step += access_size * 4;
 				// store the page to mcdram
-		        MemReq insert_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				_mcdram[mcdram_select]->access(insert_req, 2, access_size*4);
+		        MemReq insert_req = {address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				data_ready_cycle = std::max(data_ready_cycle,
+						mcdramBlockAccess(insert_req, set_num, replace_way, MemReq::DRAMCACHE_FILL, access_size*4, &page_load));
 				_mc_bw_per_step += access_size * 4;
 				if (_scheme == Tagless) {
 		        	MemReq load_gipt_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 		        	MemReq store_gipt_req = {tag * 64, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-					_ext_dram->access(load_gipt_req, 2, 2); // update GIPT
-					_ext_dram->access(store_gipt_req, 2, 2); // update GIPT
+					memAccess(_ext_dram, load_gipt_req, 2, 2); // update GIPT
+					memAccess(_ext_dram, store_gipt_req, 2, 2); // update GIPT
 					_ext_bw_per_step += 4;
 				} else if (!_sram_tag) {
-					_mcdram[mcdram_select]->access(insert_req, 2, 2); // store tag
+					mcdramAccess(insert_req, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 2, 2); // store tag
 					_mc_bw_per_step += 2;
 				}
 				_numTagStore.inc();
@@ -439,6 +506,8 @@ MemoryController::access(MemReq& req)
          	if (_cache[set_num].ways[replace_way].valid)
 			{
 				Address replaced_tag = _cache[set_num].ways[replace_way].tag;
+				if (_profiler)
+					_profiler->recordEviction(set_num, replaced_tag, req.cycle);
 				// Note that tag_buffer is not updated if placed into an invalid entry.
 				// this is like ignoring the initialization cost 
 				if (_scheme == HybridCache) {
@@ -477,46 +546,48 @@ MemoryController::access(MemReq& req)
 					// Store starts after TAD is loaded.
 					// request not on critical path. 
 					if (_scheme == AlloyCache) {
+						DagNode victim_read = lookup;
 						if (type == STORE) {
 							if (_sram_tag) {
-			        	    	MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								req.cycle = _mcdram[mcdram_select]->access(load_req, 2, 4);
+			        	    	MemReq load_req = {address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+								req.cycle = mcdramAccess(load_req, _layout->dataLine(set_num, replace_way, address), MemReq::DRAMCACHE_EVICT, 2, 4, &lookup);
+								victim_read = _dag_last;
 								_mc_bw_per_step += 4;
 								//_numTagLoad.inc();
 							}
 						}
 		        	    MemReq wb_req = {_cache[set_num].ways[replace_way].tag, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, 4);
+						data_ready_cycle = std::max(data_ready_cycle, postWrite(_ext_dram, wb_req, 4, &victim_read));
 						_ext_bw_per_step += 4;
 					} else if (_scheme == HybridCache) {
 						// load page from mcdram
-				        MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_mcdram[mcdram_select]->access(load_req, 2, (_granularity / 64)*4);
+				        MemReq load_req = {address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+						mcdramBlockAccess(load_req, set_num, replace_way, MemReq::DRAMCACHE_EVICT, (_granularity / 64)*4, &lookup);
+						DagNode victim_read = _dag_last;
 						_mc_bw_per_step += (_granularity / 64)*4;
-						// store page to ext dram
-						// TODO. this event should be appended under the one above. 
-						// but they are parallel right now.
+						// store page to ext dram, once it is read (with
+						// weave timing; otherwise the two are parallel)
 	        	    	MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, (_granularity / 64) * 4);
+						data_ready_cycle = std::max(data_ready_cycle, postWrite(_ext_dram, wb_req, (_granularity / 64) * 4, &victim_read));
 						_ext_bw_per_step += (_granularity / 64) * 4;
 					} else if (_scheme == UnisonCache || _scheme == Tagless) {
 						assert(unison_dirty_lines > 0);
 						// load page from mcdram
 						assert(unison_dirty_lines <= 64);
-				        MemReq load_req = {mc_address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_mcdram[mcdram_select]->access(load_req, 2, unison_dirty_lines*4);
+				        MemReq load_req = {address, GETS, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
+						mcdramBlockAccess(load_req, set_num, replace_way, MemReq::DRAMCACHE_EVICT, unison_dirty_lines*4, &lookup);
+						DagNode victim_read = _dag_last;
 						_mc_bw_per_step += unison_dirty_lines*4;
-						// store page to ext dram
-						// TODO. this event should be appended under the one above. 
-						// but they are parallel right now.
+						// store page to ext dram, once it is read (with
+						// weave timing; otherwise the two are parallel)
 	        	    	MemReq wb_req = {_cache[set_num].ways[replace_way].tag * 64, PUTX, req.childId, &state, cur_cycle, req.childLock, req.initialState, req.srcId, req.flags};
-						_ext_dram->access(wb_req, 2, unison_dirty_lines*4);
+						data_ready_cycle = std::max(data_ready_cycle, postWrite(_ext_dram, wb_req, unison_dirty_lines*4, &victim_read));
 						_ext_bw_per_step += unison_dirty_lines*4;
 						if (_scheme == Tagless) {
 				        	MemReq load_gipt_req = {tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
 				        	MemReq store_gipt_req = {tag * 64, PUTS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-							_ext_dram->access(load_gipt_req, 2, 2); // update GIPT
-							_ext_dram->access(store_gipt_req, 2, 2); // update GIPT
+							memAccess(_ext_dram, load_gipt_req, 2, 2); // update GIPT
+							memAccess(_ext_dram, store_gipt_req, 2, 2); // update GIPT
 							_ext_bw_per_step += 4;
 						} 
 					}
@@ -532,6 +603,8 @@ MemoryController::access(MemReq& req)
 			_cache[set_num].ways[replace_way].tag = tag;
          	_cache[set_num].ways[replace_way].dirty = (req.type == PUTX);
          	_tlb[tag].way = replace_way;
+			if (_profiler)
+				_profiler->recordFill(set_num, tag, req.cycle);
 			if (_scheme == UnisonCache || _scheme == Tagless) {
 				uint64_t bit = (address - tag * 64) / 4;
 				assert(bit < 16 && bit >= 0);
@@ -553,27 +626,27 @@ MemoryController::access(MemReq& req)
 		assert(set_num >= _ds_index);
 		if (_scheme == AlloyCache) {
 			if (type == LOAD && _sram_tag) {
-		        MemReq read_req = {mc_address, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _mcdram[mcdram_select]->access(read_req, 0, 4);
+		        MemReq read_req = {address, GETX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				req.cycle = mcdramAccess(read_req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 0, 4);
 				_mc_bw_per_step += 4;
 			} 
 			if (type == STORE) {
 				// LLC dirty eviction hit
-		        MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _mcdram[mcdram_select]->access(write_req, 0, 4);
+		        MemReq write_req = {address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				req.cycle = mcdramAccess(write_req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 0, 4);
 				_mc_bw_per_step += 4;
 			}
 		} else if (_scheme == UnisonCache && type == STORE)	{
 			// LLC dirty eviction hit
-	        MemReq write_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			req.cycle = _mcdram[mcdram_select]->access(write_req, 1, 4);
+	        MemReq write_req = {address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			req.cycle = mcdramAccess(write_req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 1, 4);
 			_mc_bw_per_step += 4;
 		}
 		if (_scheme == AlloyCache || _scheme == UnisonCache)
 			data_ready_cycle = req.cycle;
 		_num_hit_per_step ++;
       	if (_scheme == HMA)
-        	_os_placement_policy->handleCacheAccess(tag, type);
+        	_os_placement_policy->handleCacheAccess(page, type);
       	else if (_scheme == HybridCache || _scheme == UnisonCache) {
 	       	_page_placement_policy->handleCacheHit(tag, type, set_num, &_cache[set_num], counter_access, hit_way);
 		}
@@ -588,31 +661,25 @@ MemoryController::access(MemReq& req)
 	
 		if (_scheme == HybridCache) {
 			if (!hybrid_tag_probe) {
-				req.lineAddr = mc_address; 
-				req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
+				req.cycle = mcdramAccess(req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 0, 4);
 				_mc_bw_per_step += 4;
-				req.lineAddr = address;
 				data_ready_cycle = req.cycle;
 				if (type == LOAD && _tag_buffer->canInsert(tag)) 
 					_tag_buffer->insert(tag, false);
 			} else {
 				assert(!_sram_tag);
-	            MemReq tag_probe = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-				req.cycle = _mcdram[mcdram_select]->access(tag_probe, 0, 2);
+	            MemReq tag_probe = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+				req.cycle = mcdramAccess(tag_probe, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 0, 2);
 				_mc_bw_per_step += 2;
 				_numTagLoad.inc();
-				req.lineAddr = mc_address; 
-				req.cycle = _mcdram[mcdram_select]->access(req, 1, 4);
+				req.cycle = mcdramAccess(req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 1, 4);
 				_mc_bw_per_step += 4;
-				req.lineAddr = address;
 				data_ready_cycle = req.cycle;
 			}
 		}
 		else if (_scheme == Tagless) {
-			req.lineAddr = mc_address; 
-			req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
+			req.cycle = mcdramAccess(req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 0, 4);
 			_mc_bw_per_step += 4;
-			req.lineAddr = address;
 			data_ready_cycle = req.cycle;
 			
 			uint64_t bit = (address - tag * 64) / 4;
@@ -625,16 +692,14 @@ MemoryController::access(MemReq& req)
 
 		//// data access  
 		if (_scheme == HMA) {
-			req.lineAddr = mc_address; //transMCAddressPage(set_num, hit_way); //mc_address;
-			req.cycle = _mcdram[mcdram_select]->access(req, 0, 4);
+			req.cycle = mcdramAccess(req, _layout->dataLine(set_num, hit_way, address), MemReq::DRAMCACHE_DATA, 0, 4);
 			_mc_bw_per_step += 4;
-			req.lineAddr = address;
 			data_ready_cycle = req.cycle;
 		}
 		if (_scheme == UnisonCache) {
 			// Update LRU information for UnisonCache
-		    MemReq tag_update_req = {mc_address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-			_mcdram[mcdram_select]->access(tag_update_req, 2, 2);
+		    MemReq tag_update_req = {address, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			mcdramAccess(tag_update_req, _layout->tagLine(set_num, address), MemReq::DRAMCACHE_TAG, 2, 2);
 			_mc_bw_per_step += 2;
 			_numTagStore.inc();
 			uint64_t bit = (address - tag * 64) / 4;
@@ -654,10 +719,11 @@ MemoryController::access(MemReq& req)
 		// One counter read and one coutner write
 		assert(set_num >= _ds_index);
 		_numCounterAccess.inc();
-        MemReq counter_req = {mc_address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-		_mcdram[mcdram_select]->access(counter_req, 2, 2);
+        MemReq counter_req = {address, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+		Address counter_line = _layout->counterLine(set_num, address);
+		mcdramAccess(counter_req, counter_line, MemReq::DRAMCACHE_COUNTER, 2, 2);
 		counter_req.type = PUTX;
-		_mcdram[mcdram_select]->access(counter_req, 2, 2);
+		mcdramAccess(counter_req, counter_line, MemReq::DRAMCACHE_COUNTER, 2, 2);
 		_mc_bw_per_step += 4;
 		//////////////////////////////////////
 	}
@@ -668,11 +734,39 @@ MemoryController::access(MemReq& req)
 		_numTagBufferFlush.inc();
 	}
 
-	// TODO. Make the timing info here correct.
-	// TODO. should model system level stall 
 	if (_scheme == HMA && _num_requests % _os_quantum == 0) {
       	uint64_t num_replace = _os_placement_policy->remapPages();
 		_numPlacement.inc(num_replace * 2);
+		// Page migration traffic. Not on the critical path, but it competes
+		// for bandwidth in both DRAMs.
+		uint32_t page_size = (_granularity / 64) * 4;
+		const g_vector<Address> & promoted = _os_placement_policy->getPromotedPages();
+		const g_vector<Address> & demoted = _os_placement_policy->getDemotedPages();
+		for (Address page_tag : promoted) {
+			if (_profiler)
+				_profiler->recordFill(0, page_tag, req.cycle);
+			Address page_addr = page_tag * (_granularity / 64);
+	        MemReq load_req = {page_tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			memAccess(_ext_dram, load_req, 2, page_size);
+			DagNode page_load = _dag_last;
+	        MemReq insert_req = {page_addr, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			data_ready_cycle = std::max(data_ready_cycle, mcdramPostWrite(insert_req, page_addr, MemReq::DRAMCACHE_FILL, page_size, &page_load));
+			_ext_bw_per_step += page_size;
+			_mc_bw_per_step += page_size;
+		}
+		for (Address page_tag : demoted) {
+			Address page_addr = page_tag * (_granularity / 64);
+	        MemReq load_req = {page_addr, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			mcdramAccess(load_req, page_addr, MemReq::DRAMCACHE_EVICT, 2, page_size);
+			DagNode page_read = _dag_last;
+	        MemReq wb_req = {page_tag * 64, PUTX, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
+			data_ready_cycle = std::max(data_ready_cycle, postWrite(_ext_dram, wb_req, page_size, &page_read));
+			_ext_bw_per_step += page_size;
+			_mc_bw_per_step += page_size;
+		}
+		_numDirtyEviction.inc(demoted.size());
+		// The request that triggers the remap waits for the OS
+		data_ready_cycle += (promoted.size() + demoted.size()) * _os_stall_per_page;
    	}
 
 	if (_num_requests % step_length == 0)
@@ -710,9 +804,10 @@ MemoryController::access(MemReq& req)
 							if (meta.valid && meta.dirty) {
 								// should write back to external dram. 					
 						        MemReq load_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								_mcdram[mc]->access(load_req, 2, (_granularity / 64)*4);
+								memAccess(_mcdram->getChannel(mc), load_req, 2, (_granularity / 64)*4);
+								DagNode page_read = _dag_last;
 						        MemReq wb_req = {meta.tag * 64, GETS, req.childId, &state, req.cycle, req.childLock, req.initialState, req.srcId, req.flags};
-								_ext_dram->access(wb_req, 2, (_granularity / 64)*4);
+								memAccess(_ext_dram, wb_req, 2, (_granularity / 64)*4, &page_read);
 								_ext_bw_per_step += (_granularity / 64)*4;
 								_mc_bw_per_step += (_granularity / 64)*4;
 							}
@@ -740,36 +835,168 @@ MemoryController::access(MemReq& req)
 			printf("_ds_index = %ld/%ld\n", _ds_index, _num_sets);
 		}
 	}
+ 	if (_weave_timing)
+		dagFinish(req, data_ready_cycle);
  	futex_unlock(&_lock);
 	//uint64_t latency = req.cycle - orig_cycle;
 	//req.cycle = orig_cycle;
 	return data_ready_cycle; //req.cycle + latency;
 }
 
+uint64_t
+MemoryController::memAccess(MemObject * mem, MemReq & req, int type, uint32_t data_size, const DagNode * after)
+{
+	if (!_weave_timing || !_dag_rec)
+		return mem->access(req, type, data_size);
+	// Each access is recorded on its own and then linked into the DAG
+	_dag_last.ev = nullptr;
+	assert(!_dag_rec->hasRecord());
+	uint64_t resp_cycle = mem->access(req, 0, data_size);
+	if (!_dag_rec->hasRecord())
+		return resp_cycle;  // PUTS, or a memory without a weave-phase model
+	TimingRecord tr = _dag_rec->popRecord();
+	bool critical = (type != 2);
+	dagLink((!critical && after && after->ev)? *after : _dag_tail, tr.startEvent, req.cycle);
+	_dag_last = {tr.endEvent, resp_cycle};
+	if (critical)
+		_dag_tail = _dag_last;
+	return resp_cycle;
+}
+
+uint64_t
+MemoryController::postWrite(MemObject * mem, MemReq & wr_req, uint32_t data_size, const DagNode * after)
+{
+	uint64_t accept_cycle = mem->writeAcceptCycle(wr_req.lineAddr, wr_req.cycle, data_size);
+	if (accept_cycle > wr_req.cycle) {
+		_numWriteStalls.inc();
+		_numWriteStallCycles.inc(accept_cycle - wr_req.cycle);
+	}
+	// The write enters the buffer, and the weave-phase queue, once accepted
+	MemReq accepted_req = wr_req;
+	accepted_req.cycle = accept_cycle;
+	memAccess(mem, accepted_req, 2, data_size, after);
+	return accept_cycle;
+}
+
+uint64_t
+MemoryController::mcdramAccess(const MemReq & req, Address mc_line, MemReq::Flag acc_class, int type, uint32_t data_size,
+		const DagNode * after)
+{
+	MemReq mc_req = req;
+	mc_req.lineAddr = mc_line;
+	mc_req.set(acc_class);
+	return memAccess(_mcdram, mc_req, type, data_size, after);
+}
+
+uint64_t
+MemoryController::mcdramPostWrite(const MemReq & req, Address mc_line, MemReq::Flag acc_class, uint32_t data_size,
+		const DagNode * after)
+{
+	MemReq mc_req = req;
+	mc_req.lineAddr = mc_line;
+	mc_req.set(acc_class);
+	return postWrite(_mcdram, mc_req, data_size, after);
+}
+
+uint64_t
+MemoryController::mcdramBlockAccess(const MemReq & req, uint64_t set_num, uint32_t way, MemReq::Flag acc_class, uint32_t data_size,
+		const DagNode * after)
+{
+	bool write = (req.type == PUTX);
+	if (!_layout->isSetLayout()) {
+		if (write)
+			return mcdramPostWrite(req, req.lineAddr, acc_class, data_size, after);
+		return mcdramAccess(req, req.lineAddr, acc_class, 2, data_size, after);
+	}
+	// One access per row the block spans; all of them in parallel
+	uint32_t bursts_per_line = zinfo->lineSize / 16;
+	uint64_t cycle = req.cycle;
+	uint64_t offset = 0;
+	DagNode pieces = {nullptr, req.cycle};
+	while (data_size) {
+		uint64_t lines = _layout->contiguousLines(set_num, way, offset);
+		uint32_t bursts = std::min<uint64_t>(data_size, lines * bursts_per_line);
+		Address mc_line = _layout->dataLine(set_num, way, offset);
+		if (write)
+			cycle = std::max(cycle, mcdramPostWrite(req, mc_line, acc_class, bursts, after));
+		else
+			cycle = std::max(cycle, mcdramAccess(req, mc_line, acc_class, 2, bursts, after));
+		if (_weave_timing)
+			dagJoin(pieces, _dag_last);
+		offset += lines;
+		data_size -= bursts;
+	}
+	if (_weave_timing)
+		_dag_last = pieces;
+	return cycle;
+}
+
+TimingEvent *
+MemoryController::dagStart()
+{
+	if (!_dag_start) {
+		_dag_start = new (_dag_rec) DelayEvent(0);
+		_dag_start->setMinStartCycle(_dag_start_cycle);
+	}
+	return _dag_start;
+}
+
+void
+MemoryController::dagLink(const DagNode & parent, TimingEvent * child, uint64_t start_cycle)
+{
+	TimingEvent * ev = parent.ev? parent.ev : dagStart();
+	uint64_t cycle = parent.ev? parent.cycle : _dag_start_cycle;
+	// Keep bound-phase gaps (e.g., SRAM tag lookups) that no event models
+	if (start_cycle > cycle) {
+		DelayEvent * delay = new (_dag_rec) DelayEvent(start_cycle - cycle);
+		delay->setMinStartCycle(cycle);
+		ev = ev->addChild(delay, _dag_rec);
+	}
+	ev->addChild(child, _dag_rec);
+}
+
+void
+MemoryController::dagJoin(DagNode & join, const DagNode & node)
+{
+	if (!node.ev)
+		return;
+	if (!join.ev) {
+		join = node;
+		return;
+	}
+	DelayEvent * ev = new (_dag_rec) DelayEvent(0);
+	uint64_t cycle = std::max(join.cycle, node.cycle);
+	ev->setMinStartCycle(cycle);
+	join.ev->addChild(ev, _dag_rec);
+	node.ev->addChild(ev, _dag_rec);
+	join = {ev, cycle};
+}
+
+void
+MemoryController::dagFinish(const MemReq & req, uint64_t resp_cycle)
+{
+	if (!_dag_start)
+		return;  // nothing recorded
+	// The response follows the critical path, plus whatever the bound phase
+	// adds on top of it (write buffer stalls, OS remaps)
+	uint64_t tail_cycle = _dag_tail.ev? std::min(_dag_tail.cycle, resp_cycle) : _dag_start_cycle;
+	DelayEvent * resp = new (_dag_rec) DelayEvent(resp_cycle - tail_cycle);
+	resp->setMinStartCycle(tail_cycle);
+	(_dag_tail.ev? _dag_tail.ev : _dag_start)->addChild(resp, _dag_rec);
+	TimingRecord tr = {req.lineAddr, _dag_start_cycle, resp_cycle, req.type, _dag_start, resp};
+	_dag_rec->pushRecord(tr);
+	_dag_start = nullptr;
+}
+
 DDRMemory* 
 MemoryController::BuildDDRMemory(Config& config, uint32_t frequency, 
 								 uint32_t domain, g_string name, const string& prefix, uint32_t tBL, double timing_scale) 
 {
-    uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
-    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
-    uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
-    const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
-    const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
-
-    // If set, writes are deferred and bursted out to reduce WTR overheads
-    bool deferWrites = config.get<bool>(prefix + "deferWrites", true);
-    bool closedPage = config.get<bool>(prefix + "closedPage", true);
-
-    // Max row hits before we stop prioritizing further row hits to this bank.
-    // Balances throughput and fairness; 0 -> FCFS / high (e.g., -1) -> pure FR-FCFS
-    uint32_t maxRowHits = config.get<uint32_t>(prefix + "maxRowHits", 4);
-
-    // Request queues
-    uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
-    uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
-
-    auto mem = (DDRMemory *) gm_malloc(sizeof(DDRMemory));
-	new (mem) DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech, addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name, tBL, timing_scale);
+    DDRMemoryConfig cfg(config, prefix);
+    auto mem = gm_page_alloc<DDRMemory>();
+	new (mem) DDRMemory(zinfo->lineSize, cfg.pageSize, cfg.ranksPerChannel, cfg.banksPerRank, frequency, cfg.tech, cfg.addrMapping, cfg.controllerLatency, cfg.queueDepth, cfg.maxRowHits, cfg.deferWrites, cfg.closedPage, domain, name, tBL, timing_scale);
+	mem->setPolicies(cfg);
+	mem->placeOnDomainNode();
     return mem;
 }
 
@@ -782,6 +1009,8 @@ MemoryController::initStats(AggregateStat* parentStat)
 	_numPlacement.init("placement", "Number of Placement"); memStats->append(&_numPlacement);
 	_numCleanEviction.init("cleanEvict", "Clean Eviction"); memStats->append(&_numCleanEviction);
 	_numDirtyEviction.init("dirtyEvict", "Dirty Eviction"); memStats->append(&_numDirtyEviction);
+	_numWriteStalls.init("wrStalls", "Requests stalled by a full DRAM write buffer"); memStats->append(&_numWriteStalls);
+	_numWriteStallCycles.init("wrStallCycles", "Cycles stalled by full DRAM write buffers"); memStats->append(&_numWriteStallCycles);
 	_numLoadHit.init("loadHit", "Load Hit"); memStats->append(&_numLoadHit);
 	_numLoadMiss.init("loadMiss", "Load Miss"); memStats->append(&_numLoadMiss);
 	_numStoreHit.init("storeHit", "Store Hit"); memStats->append(&_numStoreHit);
@@ -798,28 +1027,36 @@ MemoryController::initStats(AggregateStat* parentStat)
 	_numTouchedLines.init("totalTouchLines", "total # of touched lines in UnisonCache"); memStats->append(&_numTouchedLines);
 	_numEvictedLines.init("totalEvictLines", "total # of evicted lines in UnisonCache"); memStats->append(&_numEvictedLines);
 
-	_ext_dram->initStats(memStats);
-	for (uint32_t i = 0; i < _mcdram_per_mc; i++) 
-		_mcdram[i]->initStats(memStats);
+	// DRAM energy (pJ) and power (mW), summed over this controller's DDR channels
+	if (!_ext_ddrs.empty() || !_mcdram_ddrs.empty()) {
+		auto energyOf = [](const g_vector<DDRMemory *> & ddrs) -> double {
+			double energy = 0.0;
+			for (auto ddr : ddrs) energy += ddr->getEnergy();
+			return energy;
+		};
+		auto extEnergyStat = makeLambdaStat([this, energyOf]() -> uint64_t { return energyOf(_ext_ddrs); });
+		extEnergyStat->init("extDramEnergy", "Off-package DRAM energy (pJ)"); memStats->append(extEnergyStat);
+		auto mcdramEnergyStat = makeLambdaStat([this, energyOf]() -> uint64_t { return energyOf(_mcdram_ddrs); });
+		mcdramEnergyStat->init("mcdramEnergy", "In-package DRAM energy (pJ)"); memStats->append(mcdramEnergyStat);
+		auto powerStat = makeLambdaStat([this, energyOf]() -> uint64_t {
+			// All channels see the same elapsed time
+			DDRMemory * ddr = _ext_ddrs.empty()? _mcdram_ddrs[0] : _ext_ddrs[0];
+			double ns = ddr->getElapsedNs();
+			return ns? (energyOf(_ext_ddrs) + energyOf(_mcdram_ddrs)) / ns : 0;
+		});
+		powerStat->init("dramPower", "Average DRAM power (mW)"); memStats->append(powerStat);
+	}
 
-    parentStat->append(memStats);
-}
+	if (_profiler)
+		_profiler->initStats(memStats);
 
+	_ext_dram->initStats(memStats);
+	if (_scheme != NoCache)
+		_mcdram->initStats(memStats);
 
-Address 
-MemoryController::transMCAddress(Address mc_addr)
-{
-	// 28 lines per DRAM row (2048 KB row)
-	uint64_t num_lines_per_mc = 128*1024*1024 / 2048 * 28; 
-	uint64_t set = mc_addr % num_lines_per_mc;
-	return set / 28 * 32 + set % 28; 
+    parentStat->append(memStats);
 }
 
-Address 
-MemoryController::transMCAddressPage(uint64_t set_num, uint32_t way_num)
-{
-	return (_num_ways * set_num + way_num) * _granularity;
-}
 
 TagBuffer::TagBuffer(Config & config)
 {
@@ -827,25 +1064,17 @@ TagBuffer::TagBuffer(Config & config)
 	_num_ways = 8; 
 	_num_sets = tb_size / _num_ways;
 	_entry_occupied = 0;
-	_tag_buffer = (TagBufferEntry **) gm_malloc(sizeof(TagBufferEntry *) * _num_sets);
-	//_tag_buffer = new TagBufferEntry * [_num_sets];
-	for (uint32_t i = 0; i < _num_sets; i++) {
-		_tag_buffer[i] = (TagBufferEntry *) gm_malloc(sizeof(TagBufferEntry) * _num_ways);
-		//_tag_buffer[i] = new TagBufferEntry [_num_ways];
-		for (uint32_t j = 0; j < _num_ways; j ++) {
-			_tag_buffer[i][j].remap = false; 
-			_tag_buffer[i][j].tag = 0;
-			_tag_buffer[i][j].lru = j;
-		}
-	}
+	_tag_buffer = (TagBufferEntry *) gm_malloc(sizeof(TagBufferEntry) * _num_sets * _num_ways);
+	_free_slots = (uint32_t *) gm_malloc(sizeof(uint32_t) * _num_sets);
+	clearTagBuffer();
 }
 
 uint32_t 
 TagBuffer::existInTB(Address tag) 
 {
-	uint32_t set_num = tag % _num_sets;
+	TagBufferEntry * set = getSet(tag % _num_sets);
 	for (uint32_t i = 0; i < _num_ways; i++)
-		if (_tag_buffer[set_num][i].tag == tag) {
+		if (set[i].tag == tag) {
 			//printf("existInTB\n");
 			return i;
 		}
@@ -855,20 +1084,16 @@ TagBuffer::existInTB(Address tag)
 bool 
 TagBuffer::canInsert(Address tag)
 {
-#if 1
-	uint32_t num = 0;
-	for (uint32_t i = 0; i < _num_sets; i++) 
-		for (uint32_t j = 0; j < _num_ways; j++) 
-			if (_tag_buffer[i][j].remap)
-				num ++;
-	assert(num == _entry_occupied);
-#endif
-
 	uint32_t set_num = tag % _num_sets;
-	//printf("tag_buffer=%#lx, set_num=%d, tag_buffer[set_num]=%#lx, num_ways=%d\n", 
-	//	(uint64_t)_tag_buffer, set_num, (uint64_t)_tag_buffer[set_num], _num_ways);
+#if MC_VALIDATION_LEVEL >= 1
+	validate(set_num);
+#endif
+	if (_free_slots[set_num] > 0)
+		return true;
+	// All entries are remapped; we can still insert if the tag is already there
+	TagBufferEntry * set = getSet(set_num);
 	for (uint32_t i = 0; i < _num_ways; i++)
-		if (!_tag_buffer[set_num][i].remap || _tag_buffer[set_num][i].tag == tag)
+		if (set[i].tag == tag)
 			return true;
 	return false;
 }
@@ -881,11 +1106,15 @@ TagBuffer::canInsert(Address tag1, Address tag2)
 	if (set_num1 != set_num2)
 		return canInsert(tag1) && canInsert(tag2);
 	else {
-		uint32_t num = 0;
+#if MC_VALIDATION_LEVEL >= 1
+		validate(set_num1);
+#endif
+		uint32_t num = _free_slots[set_num1];
+		if (num >= 2)
+			return true;
+		TagBufferEntry * set = getSet(set_num1);
 		for (uint32_t i = 0; i < _num_ways; i++)
-			if (!_tag_buffer[set_num1][i].remap 
-				|| _tag_buffer[set_num1][i].tag == tag1 
-				|| _tag_buffer[set_num1][i].tag == tag2)
+			if (set[i].remap && (set[i].tag == tag1 || set[i].tag == tag2))
 				num ++;
 		return num >= 2;
 	}
@@ -895,27 +1124,21 @@ void
 TagBuffer::insert(Address tag, bool remap)
 {
 	uint32_t set_num = tag % _num_sets;
+	TagBufferEntry * set = getSet(set_num);
 	uint32_t exist_way = existInTB(tag);
-#if 1
-	for (uint32_t i = 0; i < _num_ways; i++) 
-		for (uint32_t j = i+1; j < _num_ways; j++) { 
-			//if (_tag_buffer[set_num][i].tag != 0 && _tag_buffer[set_num][i].tag == _tag_buffer[set_num][j].tag) {
-			//	for (uint32_t k = 0; k < _num_ways; k++) 
-			//		printf("_tag_buffer[%d][%d]: tag=%ld, remap=%d\n", 
-			//			set_num, k, _tag_buffer[set_num][k].tag, _tag_buffer[set_num][k].remap);
-			//}
-			assert(_tag_buffer[set_num][i].tag != _tag_buffer[set_num][j].tag
-				  || _tag_buffer[set_num][i].tag == 0);
-		}
+#if MC_VALIDATION_LEVEL >= 1
+	validate(set_num);
 #endif
 	if (exist_way < _num_ways) {
 		// the tag already exists in the Tag Buffer
-		assert(tag == _tag_buffer[set_num][exist_way].tag);
+		assert(tag == set[exist_way].tag);
 		if (remap) {
-			if (!_tag_buffer[set_num][exist_way].remap)
+			if (!set[exist_way].remap) {
 				_entry_occupied ++;
-			_tag_buffer[set_num][exist_way].remap = true;
-		} else if (!_tag_buffer[set_num][exist_way].remap)
+				_free_slots[set_num] --;
+			}
+			set[exist_way].remap = true;
+		} else if (!set[exist_way].remap)
 			updateLRU(set_num, exist_way);
 		return;
 	}
@@ -923,31 +1146,33 @@ TagBuffer::insert(Address tag, bool remap)
 	uint32_t max_lru = 0;
 	uint32_t replace_way = _num_ways;
 	for (uint32_t i = 0; i < _num_ways; i++) {
-		if (!_tag_buffer[set_num][i].remap && _tag_buffer[set_num][i].lru >= max_lru) {
-			max_lru = _tag_buffer[set_num][i].lru;
+		if (!set[i].remap && set[i].lru >= max_lru) {
+			max_lru = set[i].lru;
 			replace_way = i;
 		}
 	}
 	assert(replace_way != _num_ways);
-	_tag_buffer[set_num][replace_way].tag = tag;
-	_tag_buffer[set_num][replace_way].remap = remap;
+	set[replace_way].tag = tag;
+	set[replace_way].remap = remap;
 	if (!remap) { 
 		//printf("\tset=%d way=%d, insert. no remap\n", set_num, replace_way);
 		updateLRU(set_num, replace_way);
 	} else { 
 		//printf("set=%d way=%d, insert\n", set_num, replace_way);
 		_entry_occupied ++;
+		_free_slots[set_num] --;
 	}
 }
 
 void 
 TagBuffer::updateLRU(uint32_t set_num, uint32_t way)
 {
-	assert(!_tag_buffer[set_num][way].remap);
+	TagBufferEntry * set = getSet(set_num);
+	assert(!set[way].remap);
 	for (uint32_t i = 0; i < _num_ways; i++)
-		if (!_tag_buffer[set_num][i].remap && _tag_buffer[set_num][i].lru < _tag_buffer[set_num][way].lru)
-			_tag_buffer[set_num][i].lru ++;
-	_tag_buffer[set_num][way].lru = 0;
+		if (!set[i].remap && set[i].lru < set[way].lru)
+			set[i].lru ++;
+	set[way].lru = 0;
 }
 
 void 
@@ -955,10 +1180,34 @@ TagBuffer::clearTagBuffer()
 {
 	_entry_occupied = 0;
 	for (uint32_t i = 0; i < _num_sets; i++) {
+		_free_slots[i] = _num_ways;
+		TagBufferEntry * set = getSet(i);
 		for (uint32_t j = 0; j < _num_ways; j ++) {
-			_tag_buffer[i][j].remap = false; 
-			_tag_buffer[i][j].tag = 0;
-			_tag_buffer[i][j].lru = j;
+			set[j].remap = false; 
+			set[j].tag = 0;
+			set[j].lru = j;
 		}
 	}
 }
+
+void 
+TagBuffer::validate(uint32_t set_num)
+{
+	// No duplicate tags within a set, and the free-slot counter matches
+	TagBufferEntry * set = getSet(set_num);
+	uint32_t num_free = 0;
+	for (uint32_t i = 0; i < _num_ways; i++) {
+		if (!set[i].remap)
+			num_free ++;
+		for (uint32_t j = i+1; j < _num_ways; j++) 
+			assert(set[i].tag != set[j].tag || set[i].tag == 0);
+	}
+	assert(num_free == _free_slots[set_num]);
+#if MC_VALIDATION_LEVEL >= 2
+	uint32_t num = 0;
+	for (uint32_t i = 0; i < _num_sets * _num_ways; i++) 
+		if (_tag_buffer[i].remap)
+			num ++;
+	assert(num == _entry_occupied);
+#endif
+}
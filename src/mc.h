@@ -10,6 +10,14 @@
 
 #define MAX_STEPS 10000
 
+// Validation level for the DRAM cache metadata (tag buffer, FBR chunks).
+// 0: no checks; 1: per-set consistency checks (O(ways) per access);
+// 2: also scan whole structures on every access (O(N), very slow).
+// Debug builds set this to 2 (see SConstruct); opt and release builds leave it at 0.
+#ifndef MC_VALIDATION_LEVEL
+#define MC_VALIDATION_LEVEL 0
+#endif
+
 enum ReqType
 {
 	LOAD = 0,
@@ -77,7 +85,14 @@ public:
 	uint64_t getClearTime() { return _last_clear_time; };
 private:
 	void updateLRU(uint32_t set_num, uint32_t way);
-	TagBufferEntry ** _tag_buffer;
+	void validate(uint32_t set_num);
+	TagBufferEntry * getSet(uint32_t set_num) { return &_tag_buffer[set_num * _num_ways]; };
+
+	// Flat [set][way] array, so a set's ways share cache lines
+	TagBufferEntry * _tag_buffer;
+	// Per-set number of entries that are not pinned by a remap, i.e., the
+	// entries a new remap can still take.
+	uint32_t * _free_slots;
 	uint32_t _num_ways;
 	uint32_t _num_sets;
 	uint32_t _entry_occupied;
@@ -104,10 +119,43 @@ class OSPlacementPolicy;
 
 //class PlacementPolicy;
 class DDRMemory;
+class MultiChannelMemory;
+class DramCacheProfiler;
+class DramCacheLayout;
+class EventRecorder;
+class TimingEvent;
 
 class MemoryController : public MemObject {
 private:
+	// An access in the request's timing event DAG (sys.mem.weaveTiming)
+	struct DagNode {
+		TimingEvent * ev;  // end event; nullptr for the request's start
+		uint64_t cycle;    // bound-phase completion cycle
+	};
+
 	DDRMemory * BuildDDRMemory(Config& config, uint32_t frequency, uint32_t domain, g_string name, const std::string& prefix, uint32_t tBL, double timing_scale);
+	// All DRAM accesses of a request go through here. Without weave timing,
+	// this is mem->access(req, type, data_size). With it, the access becomes
+	// a node of the request's DAG: type 0 and 1 accesses extend the critical
+	// path, type 2 accesses start after it (or after `after`, if recorded).
+	uint64_t memAccess(MemObject * mem, MemReq & req, int type, uint32_t data_size, const DagNode * after = nullptr);
+	// Off-critical-path write; returns the cycle mem accepts it (its write buffer may be full)
+	uint64_t postWrite(MemObject * mem, MemReq & wr_req, uint32_t data_size, const DagNode * after = nullptr);
+	// DRAM cache accesses to mcdram: a copy of req goes to mc_line (see
+	// DramCacheLayout), tagged with its access class (MemReq::DRAMCACHE_*)
+	uint64_t mcdramAccess(const MemReq & req, Address mc_line, MemReq::Flag acc_class, int type, uint32_t data_size,
+			const DagNode * after = nullptr);
+	uint64_t mcdramPostWrite(const MemReq & req, Address mc_line, MemReq::Flag acc_class, uint32_t data_size,
+			const DagNode * after = nullptr);
+	// Off-critical-path fill (PUTX) or eviction read of data_size bursts of
+	// way's block, split where the layout breaks the block across rows
+	uint64_t mcdramBlockAccess(const MemReq & req, uint64_t set_num, uint32_t way, MemReq::Flag acc_class, uint32_t data_size,
+			const DagNode * after = nullptr);
+	// DAG construction helpers
+	TimingEvent * dagStart();
+	void dagLink(const DagNode & parent, TimingEvent * child, uint64_t start_cycle);
+	void dagJoin(DagNode & join, const DagNode & node);
+	void dagFinish(const MemReq & req, uint64_t resp_cycle);
 	
 	g_string _name;
 
@@ -123,9 +171,12 @@ private:
 	// External Dram Configuration
 	MemObject *	_ext_dram;
 	g_string _ext_type; 
+	// DDR channel models (ext and mcdram), for energy stats
+	g_vector<DDRMemory *> _ext_ddrs;
+	g_vector<DDRMemory *> _mcdram_ddrs;
 public:	
 	// MC-Dram Configuration
-	MemObject ** _mcdram;
+	MultiChannelMemory * _mcdram;
 	uint32_t _mcdram_per_mc;
 	g_string _mcdram_type;
 	
@@ -141,10 +192,8 @@ public:
 	uint64_t getGranularity() { return _granularity; };
 
 private:
-	// For Alloy Cache.
-	Address transMCAddress(Address mc_addr);
-	// For Page Granularity Cache
-	Address transMCAddressPage(uint64_t set_num, uint32_t way_num); 
+	// Placement of each set's tags, counters and ways in mcdram
+	DramCacheLayout * _layout;
 
 	// For Tagless.
 	// For Tagless, we don't use "Set * _cache;" as other schemes. Instead, we use the following 
@@ -174,14 +223,20 @@ private:
 	bool _bw_balance; 
 	uint64_t _ds_index;
 
+	// Hot-page / per-set profiling, nullptr if disabled
+	DramCacheProfiler * _profiler;
+
 	// TLB Hack
 	g_unordered_map <Address, TLBEntry> _tlb;
 	uint64_t _os_quantum;
+	uint32_t _os_stall_per_page;
 
     // Stats
 	Counter _numPlacement;
   	Counter _numCleanEviction;
 	Counter _numDirtyEviction;
+	Counter _numWriteStalls;
+	Counter _numWriteStallCycles;
 	Counter _numLoadHit;
 	Counter _numLoadMiss;
 	Counter _numStoreHit;
@@ -209,6 +264,17 @@ private:
 	// to model the SRAM tag
 	bool 	_sram_tag;
 	uint32_t _llc_latency;
+
+	// Weave-phase timing: each request records its DRAM accesses as a DAG of
+	// timing events (tag probe -> data or ext read -> fill, eviction read ->
+	// writeback), so the contention simulation resolves their queueing.
+	// Only valid while _lock is held.
+	bool _weave_timing;
+	EventRecorder * _dag_rec;
+	TimingEvent * _dag_start;  // created on the first recorded access
+	uint64_t _dag_start_cycle;
+	DagNode _dag_tail;         // end of the critical path
+	DagNode _dag_last;         // last recorded access (ev is nullptr if none)
 public:
 	MemoryController(g_string& name, uint32_t frequency, uint32_t domain, Config& config);
 	uint64_t access(MemReq& req);
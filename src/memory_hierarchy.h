@@ -97,6 +97,12 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        //DRAM cache access classes, set by MemoryController on its in-package DRAM accesses. Purely informative (DDRMemory keeps row buffer stats per class)
+        DRAMCACHE_TAG     = (1<<6), //Tag (or Alloy TAD) probe or update
+        DRAMCACHE_DATA    = (1<<7), //Read or write of cached data
+        DRAMCACHE_FILL    = (1<<8), //Fill of a new line or page
+        DRAMCACHE_EVICT   = (1<<9), //Read of a dirty victim to write it back
+        DRAMCACHE_COUNTER = (1<<10), //Replacement counter read or update
     };
     uint32_t flags;
 
@@ -125,6 +131,8 @@ class MemObject : public GlobAlloc {
         //Returns response cycle
         virtual uint64_t access(MemReq& req) = 0;
         virtual uint64_t access(MemReq& req, int type, uint32_t data_size) { assert(false); }; // return access(req); };
+        // Cycle at which a posted write of data_size bursts to lineAddr, issued at cycle, is accepted (write buffer backpressure)
+        virtual uint64_t writeAcceptCycle(Address lineAddr, uint64_t cycle, uint32_t data_size) { return cycle; }
         virtual void initStats(AggregateStat* parentStat) {}
         virtual const char* getName() = 0;
 };
@@ -0,0 +1,183 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "multi_channel_mem.h"
+#include <algorithm>
+#include "bithacks.h"
+#include "contention_sim.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+MultiChannelMemory::MultiChannelMemory(const g_vector<MemObject*>& _channels, const char* _name, Config& config, const std::string& prefix)
+    : name(_name)
+{
+    numChannels = _channels.size();
+    assert(numChannels > 0);
+    channels = gm_page_alloc<MemObject*>(numChannels);
+    for (uint32_t c = 0; c < numChannels; c++) channels[c] = _channels[c];
+    // 64 lines = 4096 bytes (page granularity mapping)
+    mapGranu = config.get<uint32_t>(prefix + "mapGranu", 64);
+    if (!mapGranu) panic("%s: mapGranu must be non-zero", name.c_str());
+
+    std::string hash = config.get<const char*>(prefix + "channelHash", "none");
+    if (hash == "none") {
+        channelHash = CH_NONE;
+        channelBits = 0;
+    } else if (hash == "xor") {
+        if (!isPow2(numChannels)) panic("%s: channelHash = xor needs a power-of-2 number of channels, have %d", name.c_str(), numChannels);
+        // With a single channel there is nothing to hash (and folding by 0 bits would not terminate)
+        channelHash = (numChannels > 1)? CH_XOR : CH_NONE;
+        channelBits = ilog2(numChannels);
+    } else {
+        panic("%s: invalid channelHash %s (none/xor)", name.c_str(), hash.c_str());
+    }
+
+    stripeBulk = config.get<bool>(prefix + "stripeBulk", false);
+    // Only the weave-phase DAG joins striped pieces of a new record back into one record
+    stripeRecords = stripeBulk && config.get<bool>("sys.mem.weaveTiming", false);
+    burstsPerLine = zinfo->lineSize/16;
+    assert(burstsPerLine);
+
+    info("%s: %d channels, %d-line interleaving, %s hash%s", name.c_str(), numChannels, mapGranu,
+            hash.c_str(), stripeBulk? ", striped bulk transfers" : "");
+}
+
+void MultiChannelMemory::placeOnDomainNode(uint32_t domain) {
+    zinfo->contentionSim->placeOnDomainNode(this, hostPageBytes(sizeof(MultiChannelMemory)), domain);
+    zinfo->contentionSim->placeOnDomainNode(channels, hostPageBytes(sizeof(MemObject*)*numChannels), domain);
+}
+
+void MultiChannelMemory::initStats(AggregateStat* parentStat) {
+    AggregateStat* memStats = new AggregateStat();
+    memStats->init(name.c_str(), "Multi-channel memory stats");
+    profReqs.init("chReqs", "Requests per channel", numChannels); memStats->append(&profReqs);
+    profLines.init("chLines", "Lines transferred per channel", numChannels); memStats->append(&profLines);
+    profStriped.init("striped", "Bulk transfers striped over several channels"); memStats->append(&profStriped);
+    auto imbalance = [this]() -> uint64_t {
+        uint64_t total = 0, max = 0;
+        for (uint32_t c = 0; c < numChannels; c++) {
+            total += profLines.count(c);
+            max = std::max(max, profLines.count(c));
+        }
+        return total? max*numChannels*1000/total : 0;
+    };
+    auto imbalanceStat = makeLambdaStat(imbalance);
+    imbalanceStat->init("imbalance", "Lines on the busiest channel over the per-channel mean, x1000");
+    memStats->append(imbalanceStat);
+    parentStat->append(memStats);
+
+    for (uint32_t c = 0; c < numChannels; c++) channels[c]->initStats(parentStat);
+}
+
+uint64_t MultiChannelMemory::access(MemReq& req) {
+    uint32_t ch = channelOf(req.lineAddr / mapGranu);
+    Address lineAddr = req.lineAddr;
+    req.lineAddr = channelAddr(lineAddr);
+    uint64_t respCycle = channels[ch]->access(req);
+    req.lineAddr = lineAddr;
+    profReqs.inc(ch);
+    profLines.inc(ch);
+    return respCycle;
+}
+
+uint64_t MultiChannelMemory::access(MemReq& req, int type, uint32_t data_size) {
+    uint32_t lines = (data_size + burstsPerLine - 1) / burstsPerLine;
+    // Background transfers (type 2) are striped as parallel children of the
+    // current record's end event. With weave timing, new records (type 0) are
+    // striped as parallel pieces between a fork and a join event. Type 1 would
+    // chain the pieces into one sequence, so it is never striped.
+    bool stripe = (type == 2)? stripeBulk : (type == 0)? stripeRecords : false;
+    if (!stripe || req.lineAddr % mapGranu + lines <= mapGranu) {
+        return channelAccess(req, type, data_size, lines);
+    }
+
+    EventRecorder* evRec = (type == 0)? zinfo->eventRecorders[req.srcId] : nullptr;
+    TimingEvent* forkEv = nullptr;
+    TimingEvent* joinEv = nullptr;
+
+    Address lineAddr = req.lineAddr;
+    uint64_t respCycle = req.cycle;
+    uint32_t bursts = data_size;
+    while (bursts) {
+        uint32_t unitLines = mapGranu - req.lineAddr % mapGranu;
+        uint32_t pieceBursts = std::min(bursts, unitLines*burstsPerLine);
+        uint32_t pieceLines = (pieceBursts + burstsPerLine - 1) / burstsPerLine;
+        respCycle = std::max(respCycle, channelAccess(req, type, pieceBursts, pieceLines));
+        if (evRec && evRec->hasRecord()) {
+            TimingRecord pr = evRec->popRecord();
+            if (!forkEv) {
+                forkEv = new (evRec) DelayEvent(0);
+                forkEv->setMinStartCycle(req.cycle);
+                joinEv = new (evRec) DelayEvent(0);
+            }
+            forkEv->addChild(pr.startEvent, evRec);
+            pr.endEvent->addChild(joinEv, evRec);
+        }
+        req.lineAddr += unitLines;
+        bursts -= pieceBursts;
+    }
+    req.lineAddr = lineAddr;
+    if (forkEv) {
+        joinEv->setMinStartCycle(respCycle);
+        TimingRecord tr = {lineAddr, req.cycle, respCycle, req.type, forkEv, joinEv};
+        evRec->pushRecord(tr);
+    }
+    profStriped.inc();
+    return respCycle;
+}
+
+// Posted writes are background transfers (type 2), so they are striped the
+// same way as in access(); the write is accepted once every piece is
+uint64_t MultiChannelMemory::writeAcceptCycle(Address lineAddr, uint64_t cycle, uint32_t data_size) {
+    uint32_t lines = (data_size + burstsPerLine - 1) / burstsPerLine;
+    if (!stripeBulk || lineAddr % mapGranu + lines <= mapGranu) {
+        return channels[channelOf(lineAddr / mapGranu)]->writeAcceptCycle(channelAddr(lineAddr), cycle, data_size);
+    }
+
+    uint64_t acceptCycle = cycle;
+    uint32_t bursts = data_size;
+    while (bursts) {
+        uint32_t unitLines = mapGranu - lineAddr % mapGranu;
+        uint32_t pieceBursts = std::min(bursts, unitLines*burstsPerLine);
+        uint64_t c = channels[channelOf(lineAddr / mapGranu)]->writeAcceptCycle(channelAddr(lineAddr), cycle, pieceBursts);
+        acceptCycle = std::max(acceptCycle, c);
+        lineAddr += unitLines;
+        bursts -= pieceBursts;
+    }
+    return acceptCycle;
+}
+
+uint64_t MultiChannelMemory::channelAccess(MemReq& req, int type, uint32_t data_size, uint32_t lines) {
+    uint32_t ch = channelOf(req.lineAddr / mapGranu);
+    Address lineAddr = req.lineAddr;
+    req.lineAddr = channelAddr(lineAddr);
+    uint64_t respCycle = channels[ch]->access(req, type, data_size);
+    req.lineAddr = lineAddr;
+    profReqs.inc(ch);
+    profLines.inc(ch, lines);
+    return respCycle;
+}
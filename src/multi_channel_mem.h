@@ -0,0 +1,106 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTI_CHANNEL_MEM_H_
+#define MULTI_CHANNEL_MEM_H_
+
+#include <string>
+#include "config.h"
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "host_placement.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Fans out requests to several independent channels (DDRMemory, DRAMSim,
+ * whole memory controllers...), changing each line address into the
+ * channel's own address space. Used both across memory controllers and
+ * across the DRAM cache channels of one controller.
+ *
+ * Config (under prefix):
+ *  - mapGranu: interleave unit, in lines
+ *  - channelHash: "none" (unit % channels) or "xor" (also XOR in the higher
+ *    unit bits, so power-of-2 strides do not all land on one channel;
+ *    needs a power-of-2 number of channels)
+ *  - stripeBulk: split multi-line background transfers (type 2) at
+ *    interleave unit boundaries, so e.g. a page fill uses all channels in
+ *    parallel when mapGranu is smaller than a page. With
+ *    sys.mem.weaveTiming, new records (type 0) are split too, and their
+ *    pieces are joined back into one record
+ */
+class MultiChannelMemory : public MemObject {
+    private:
+        enum ChannelHash {CH_NONE, CH_XOR};
+
+        MemObject** channels;  // on pages of their own
+        const g_string name;
+        uint32_t numChannels;
+        uint32_t channelBits;  // only for CH_XOR
+        uint32_t mapGranu;  // in lines
+        ChannelHash channelHash;
+        bool stripeBulk;
+        bool stripeRecords;  // stripe type 0 too; only with sys.mem.weaveTiming
+        uint32_t burstsPerLine;  // data_size is in 16-byte bursts, as in DDRMemory
+
+        VectorCounter profReqs;
+        VectorCounter profLines;
+        Counter profStriped;
+
+    public:
+        MultiChannelMemory(const g_vector<MemObject*>& _channels, const char* _name, Config& config, const std::string& prefix);
+
+        uint64_t access(MemReq& req);
+        uint64_t access(MemReq& req, int type, uint32_t data_size);
+        uint64_t writeAcceptCycle(Address lineAddr, uint64_t cycle, uint32_t data_size);
+
+        const char* getName() { return name.c_str(); }
+        void initStats(AggregateStat* parentStat);
+
+        // Binds this object and its channel array to the host node that
+        // simulates domain. The object must come from gm_page_alloc.
+        void placeOnDomainNode(uint32_t domain);
+
+        uint32_t getNumChannels() const { return numChannels; }
+        MemObject* getChannel(uint32_t idx) const { return channels[idx]; }
+
+    private:
+        inline uint32_t channelOf(Address unit) const {
+            if (channelHash == CH_NONE) return unit % numChannels;
+            // Units unit/numChannels*numChannels.. share their higher bits, so
+            // folding those in permutes channels within each group
+            Address ch = unit;
+            for (Address u = unit >> channelBits; u; u >>= channelBits) ch ^= u;
+            return ch & (numChannels - 1);
+        }
+
+        // Channel-local address of lineAddr (which goes to channelOf(lineAddr / mapGranu))
+        inline Address channelAddr(Address lineAddr) const {
+            return lineAddr / mapGranu / numChannels * mapGranu + lineAddr % mapGranu;
+        }
+
+        uint64_t channelAccess(MemReq& req, int type, uint32_t data_size, uint32_t lines);
+};
+
+#endif  // MULTI_CHANNEL_MEM_H_
@@ -451,8 +451,8 @@ class OOOCore : public Core {
 
         // Contention simulation interface
         inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
-        void cSimStart();
-        void cSimEnd();
+        virtual void cSimStart();
+        virtual void cSimEnd();
 
     private:
         inline void load(Address addr);
@@ -1,56 +1,71 @@
 #include "os_placement.h"
 #include "cache.h"
-#include <queue>
-#include <vector>
-#include <functional>
-
-void
-OSPlacementPolicy::handleCacheAccess(Address tag, ReqType type)
-{
-   //map<Address, TLBEntry> &tlb = *_mc->getTLB();
-   //assert(tlb.find(tag) != tlb.end());
-   //tlb[tag].count ++; 
-}
+#include <algorithm>
 
 uint64_t 
 OSPlacementPolicy::remapPages() 
 {
-   /*
-   map<Address, TLBEntry> &tlb = *_mc->getTLB();
-   // sort the pages based on frequency. 
-   // if they have the same frequency, prioritize the page already cached.
-   auto cmp = [](TLBEntry * left, TLBEntry * right) { return (left->count < right->count); };
-   priority_queue<TLBEntry *, vector<TLBEntry *>, decltype(cmp)> queue(cmp);
-   //priority_queue<TLBEntry *> queue(cmp);
-   //printf("size = %ld\n", tlb.size());
-   for(map<Address, TLBEntry>::iterator it = tlb.begin(); it != tlb.end(); ++it) {
-      // move the page out of dram cache.
-      it->second.way = _mc->getNumWays();
-      queue.push(&it->second);
-   }
-   
-   uint64_t cur_way = 0;
+   g_unordered_map<Address, TLBEntry> &tlb = *_mc->getTLB();
+   Set * cache = _mc->getSets();
+   uint64_t num_ways = _mc->getNumWays();
    assert(_mc->getNumSets() == 1);
-   uint64_t num_replace = 0;
-   for (uint64_t i = 0; i < _mc->getNumWays(); i++) {
-      if (i == tlb.size())
-         break;
-      TLBEntry * top = queue.top();
-	  if (top->way == _mc->getNumWays())
-		  num_replace ++;
-      top->way = cur_way;
-      queue.pop();
 
-      Set * cache = _mc->getSets();
-      cache[0].ways[cur_way].valid = true;
-      cache[0].ways[cur_way].tag = top->tag;
-      cache[0].ways[cur_way].dirty = false; 
-      cur_way ++;
+   _candidates.clear();
+   _free_ways.clear();
+   _promoted.clear();
+   _demoted.clear();
+   // Only pages touched in this epoch or currently cached can end up in mcdram
+   for (auto it = tlb.begin(); it != tlb.end(); ++it)
+      if (it->second.count > 0 || it->second.way != num_ways)
+         _candidates.push_back(&it->second);
+
+   // Linear-time top-K selection: the first num_ways candidates are the 
+   // hottest pages. If they have the same frequency, prioritize the page 
+   // already cached, so that it does not move.
+   uint64_t num_hot = std::min((uint64_t)_candidates.size(), num_ways);
+   if (_candidates.size() > num_ways) {
+      auto hotter = [num_ways](TLBEntry * left, TLBEntry * right) { 
+         if (left->count != right->count)
+            return left->count > right->count;
+         return left->way != num_ways && right->way == num_ways;
+      };
+      std::nth_element(_candidates.begin(), _candidates.begin() + num_ways, _candidates.end(), hotter);
    }
-   // Clear all the counters in TLB
-   for(map<Address, TLBEntry>::iterator it = tlb.begin(); it != tlb.end(); ++it)
-      it->second.count /= 2;
-   return num_replace;
-   */
-   return 0;
+
+   // Move cold pages out of mcdram
+   for (uint64_t i = num_hot; i < _candidates.size(); i++) {
+      TLBEntry * page = _candidates[i];
+      if (page->way != num_ways) {
+         Way &meta = cache[0].ways[page->way];
+         assert(meta.valid && meta.tag == page->tag);
+         if (meta.dirty)
+            _demoted.push_back(page->tag);
+         meta.valid = false;
+         meta.dirty = false;
+         page->way = num_ways;
+      }
+   }
+   for (uint32_t way = 0; way < num_ways; way++)
+      if (!cache[0].ways[way].valid)
+         _free_ways.push_back(way);
+
+   // Move hot pages in
+   for (uint64_t i = 0; i < num_hot; i++) {
+      TLBEntry * page = _candidates[i];
+      if (page->way == num_ways) {
+         assert(!_free_ways.empty());
+         uint32_t way = _free_ways.back();
+         _free_ways.pop_back();
+         page->way = way;
+         cache[0].ways[way].valid = true;
+         cache[0].ways[way].tag = page->tag;
+         cache[0].ways[way].dirty = false; 
+         _promoted.push_back(page->tag);
+      }
+   }
+
+   // Age all the counters in TLB
+   for (uint64_t i = 0; i < _candidates.size(); i++)
+      _candidates[i]->count /= 2;
+   return _promoted.size();
 }
@@ -1,15 +1,25 @@
 #pragma once
 #include "memory_hierarchy.h"
 #include "mc.h"
+#include "g_std/g_vector.h"
 
 class DramCache;
 
+// OS-managed page placement (HMA). The DRAM cache is a single fully
+// associative set of pages; every _os_quantum requests, the hottest pages
+// since the last epoch are (re)mapped into mcdram.
 class OSPlacementPolicy
 {
 public:
 	OSPlacementPolicy(MemoryController * mc) : _mc(mc) {};
-	void handleCacheAccess(Address tag, ReqType type);
+	void handleCacheAccess(TLBEntry * page, ReqType type) { page->count ++; };
+	// Selects the hottest pages and updates the mapping in the TLB and in
+	// _mc->getSets(). Returns the number of pages moved into mcdram; the
+	// moved pages are listed in getPromotedPages() and the dirty pages moved
+	// out in getDemotedPages(), so the caller can charge migration traffic.
 	uint64_t remapPages(); 
+	const g_vector<Address> & getPromotedPages() { return _promoted; };
+	const g_vector<Address> & getDemotedPages() { return _demoted; };
 	
 	void clearStats(); 
 	//void printInfo();
@@ -17,4 +27,9 @@ public:
 private:
 	
 	MemoryController * _mc;
+	// Scratch buffers, reused across epochs to avoid reallocations
+	g_vector<TLBEntry *> _candidates;
+	g_vector<uint32_t> _free_ways;
+	g_vector<Address> _promoted;
+	g_vector<Address> _demoted;
 };
@@ -2,15 +2,17 @@
 #include "mc.h"
 #include <stdlib.h>
 #include <iostream>
+#include <algorithm>
+#include <functional>
 
 void
-PagePlacementPolicy::initialize(Config & config)
+PagePlacementPolicy::initialize(Config & config, uint64_t seed)
 {
 	_num_chunks = _mc->getNumSets();
-	_chunks = (ChunkInfo *) gm_malloc(sizeof(ChunkInfo) *  _num_chunks);
 	
 	_scheme = _mc->getScheme();
 	_sample_rate = config.get<double>("sys.mem.mcdram.sampleRate");
+	_sample_threshold = Rng::sampleThreshold(_sample_rate);
     _enable_replace = config.get<bool>("sys.mem.mcdram.enableReplace", true); 
 	if (_sample_rate < 1) {
 		_max_count_size = 31; //g_max_count_size;
@@ -19,28 +21,34 @@ PagePlacementPolicy::initialize(Config & config)
 	} else 
 		_max_count_size = 255;
 
-	_num_entries_per_chunk = 9; //g_num_entries_per_chunk;
+	_num_entries_per_chunk = MAX_ENTRIES_PER_CHUNK; //g_num_entries_per_chunk;
 	//_num_stable_entries = _num_entries_per_chunk / 2;
 	assert(_num_entries_per_chunk > _mc->getNumWays());
+
+	// [ways | ChunkInfo] per set, padded to whole cache lines
+	_chunk_offset = sizeof(Way) * _mc->getNumWays();
+	_set_block_size = (_chunk_offset + sizeof(ChunkInfo) + 63) / 64 * 64;
+	_set_blocks = gm_memalign<char>(64, _set_block_size * _num_chunks);
+	Set * sets = _mc->getSets();
 	for (uint64_t i = 0; i < _num_chunks; i++)
 	{
-		_chunks[i].num_hits = 0;
-		_chunks[i].num_misses = 0;
-		_chunks[i].entries = (ChunkEntry *) gm_malloc(sizeof(ChunkEntry) * _num_entries_per_chunk);
-		for (uint32_t j = 0; j < _num_entries_per_chunk; j++)
-			_chunks[i].entries[j].valid = false;
+		sets[i].ways = (Way *) (_set_blocks + i * _set_block_size);
+		ChunkInfo * chunk = getChunk(i);
+		chunk->num_hits = 0;
+		chunk->num_misses = 0;
+		for (uint32_t j = 0; j < _num_entries_per_chunk; j++) {
+			chunk->entries[j].valid = false;
+			chunk->entries[j].tag = 0;
+			chunk->entries[j].count = 0;
+		}
+		for (uint32_t j = 0; j < _mc->getNumWays(); j++)
+			chunk->lru_bits[j] = j;
 	}
 	_histogram = NULL;
-	srand48_r(rand(), &_buffer);
+	_rng.init(seed);
 	clearStats();
 
 	g_string scheme = config.get<const char *>("sys.mem.mcdram.placementPolicy");
-	_lru_bits = (uint32_t **) gm_malloc(sizeof(uint32_t *) * _mc->getNumSets());
-	for (uint64_t i = 0; i < _mc->getNumSets(); i++) {
-		_lru_bits[i] = (uint32_t *) gm_malloc(sizeof(uint32_t) * _mc->getNumWays()); 
-		for (uint32_t j = 0; j < _mc->getNumWays(); j++)
-			_lru_bits[i][j] = j;
-	}
 	// hyrbid
 	if (scheme == "LRU")
 		_placement_policy = LRU;
@@ -53,35 +61,30 @@ PagePlacementPolicy::initialize(Config & config)
 uint32_t 
 PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access)
 {
-	uint64_t chunk_num = set_num;
-	//ChunkInfo * chunk = &_chunks[chunk_num];
-	_chunks[chunk_num].num_misses ++;
+	ChunkInfo * chunk = getChunk(set_num);
+	chunk->num_misses ++;
 	
 	if (_placement_policy == LRU)
 	{
 		if (set->hasEmptyWay()) {
-			updateLRU(set_num, set->getEmptyWay());
+			updateLRU(chunk, set->getEmptyWay());
 			return set->getEmptyWay();
 	 	}
 		if (!_enable_replace)
 			return _mc->getNumWays();
-	  	double f;
-	  	int64_t way;
-		drand48_r(&_buffer, &f);
-	  	lrand48_r(&_buffer, &way);
-		if (f < _sample_rate) {
+		if (_rng.sample(_sample_threshold)) {
 			//if (_scheme == UnisonCache) {
 				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					if (_lru_bits[set_num][i] == _mc->getNumWays() - 1) {
+					if (chunk->lru_bits[i] == _mc->getNumWays() - 1) {
 						Address victim_tag = set->ways[i].tag;
 						if (_scheme == HybridCache) {
 							if (_mc->getTagBuffer()->canInsert(tag, victim_tag)) {
-								updateLRU(set_num, i);
+								updateLRU(chunk, i);
 								return i;
 							} else 
 								return _mc->getNumWays();
 						} else { 
-							updateLRU(set_num, i);
+							updateLRU(chunk, i);
 							return i;
 						}
 					}
@@ -93,21 +96,9 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 	assert(_placement_policy == FBR);
 	assert(_enable_replace);
 
-#if 1
-	ChunkInfo * chunk = &_chunks[chunk_num];
-	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					printf("ID=%d, tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
-#endif 
+#if MC_VALIDATION_LEVEL >= 1
+	validateChunk(set, chunk);
+#endif
 
 	// for HybridCache, never replace for store (LLC dirty evict) 
 	if (type == STORE)
@@ -128,16 +119,16 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 		counter_access = true;
 		_num_counter_read ++;
 		_num_counter_write ++;
-		uint32_t idx = getChunkEntry(tag, &_chunks[chunk_num]);
+		uint32_t idx = getChunkEntry(tag, chunk);
 		if (idx == _num_entries_per_chunk)
 			return _mc->getNumWays();
-		ChunkEntry * chunk_entry = &_chunks[chunk_num].entries[idx];
+		ChunkEntry * chunk_entry = &chunk->entries[idx];
 		chunk_entry->count ++;
 		if (chunk_entry->count >= _max_count_size) 
-			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+			handleCounterOverflow(chunk, chunk_entry);
 		
-		//idx = adjustEntryOrder(&_chunks[chunk_num], idx);
-		//chunk_entry = &_chunks[chunk_num].entries[idx];
+		//idx = adjustEntryOrder(chunk, idx);
+		//chunk_entry = &chunk->entries[idx];
 		
 		// empty slots left in dram cache
 		if (empty_way < _mc->getNumWays()) {
@@ -148,24 +139,24 @@ PagePlacementPolicy::handleCacheMiss(Address tag, ReqType type, uint64_t set_num
 		else // figure if we can replace an entry. 
 		{
 			assert(idx >= _mc->getNumWays());
-			uint32_t victim_way = pickVictimWay(&_chunks[chunk_num]);
+			uint32_t victim_way = pickVictimWay(chunk);
 			assert(victim_way < _mc->getNumWays());
-/*			if (compareCounter(&_chunks[chunk_num].entries[idx], &_chunks[chunk_num].entries[victim_way]) && !_mc->getTagBuffer()->canInsert(tag, _chunks[chunk_num].entries[victim_way].tag)) 
+/*			if (compareCounter(&chunk->entries[idx], &chunk->entries[victim_way]) && !_mc->getTagBuffer()->canInsert(tag, chunk->entries[victim_way].tag)) 
 			{
 				printf("!!!!!!Occupancy = %f\n", _mc->getTagBuffer()->getOccupancy());
 				static int n = 0;
 				printf("cannot insert (%d)   occupancy=%f.  set1=%ld, set2=%ld\n", 
-						n++, _mc->getTagBuffer()->getOccupancy(), (tag % 128), _chunks[chunk_num].entries[victim_way].tag % 128);
+						n++, _mc->getTagBuffer()->getOccupancy(), (tag % 128), chunk->entries[victim_way].tag % 128);
 			}
 */			
-			if (compareCounter(&_chunks[chunk_num].entries[idx], &_chunks[chunk_num].entries[victim_way])
-				&& _mc->getTagBuffer()->canInsert(tag, _chunks[chunk_num].entries[victim_way].tag))
+			if (compareCounter(&chunk->entries[idx], &chunk->entries[victim_way])
+				&& _mc->getTagBuffer()->canInsert(tag, chunk->entries[victim_way].tag))
 			{
 				//assert(idx < _num_stable_entries);
 				// swap current way with victim way.
-				ChunkEntry tmp = _chunks[chunk_num].entries[idx];
-				_chunks[chunk_num].entries[idx] = _chunks[chunk_num].entries[victim_way];
-				_chunks[chunk_num].entries[victim_way] = tmp;
+				ChunkEntry tmp = chunk->entries[idx];
+				chunk->entries[idx] = chunk->entries[victim_way];
+				chunk->entries[victim_way] = tmp;
 				//assert(idx >= _mc->getNumWays() && idx < _num_stable_entries);
 				return victim_way;
 			} 
@@ -181,43 +172,15 @@ void
 PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t hit_way)
 {
 	assert(tag == set->ways[hit_way].tag);
+	ChunkInfo * chunk = getChunk(set_num);
 	if (_placement_policy == LRU) {
 		//if (_scheme == UnisonCache)
-			updateLRU(set_num, hit_way);
+			updateLRU(chunk, hit_way);
 		return;
 	}
-	uint64_t chunk_num = set_num;
-	ChunkInfo * chunk = &_chunks[chunk_num];
-#if 1
-	// for DEBUG
-	// the first few entries in chunk->entries must be in dram cache
-	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
-		if (set->ways[way].valid) {
-			if (set->ways[way].tag != _chunks[chunk_num].entries[way].tag)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
-						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
-				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-					printf("ID=%dm tag=%ld\n", i, set->ways[i].tag);
-			}
-			assert(set->ways[way].tag == _chunks[chunk_num].entries[way].tag);
-		}
-	// chunk->entries are properly ordered.
-	/*uint32_t min_count = 10000;
-	for (uint32_t way = 0; way < _num_stable_entries; way++)
-		if (chunk->entries[way].valid && chunk->entries[way].count < min_count)
-			min_count = chunk->entries[way].count;
-	for (uint32_t way = _num_stable_entries; way < _num_entries_per_chunk; way++)
-		if (chunk->entries[way].valid) {
-			if (chunk->entries[way].count > min_count)
-			{
-				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-					cout <<  i << " " << chunk->entries[i].valid << " " << chunk->entries[i].count << endl;
-			}
-			assert(chunk->entries[way].count <= min_count);
-		}*/
-#endif 
+#if MC_VALIDATION_LEVEL >= 1
+	validateChunk(set, chunk);
+#endif
 
 	double sample_rate = _sample_rate;
 	bool miss_rate_tune = true; //false; 
@@ -230,13 +193,13 @@ PagePlacementPolicy::handleCacheHit(Address tag, ReqType type, uint64_t set_num,
 		counter_access = true;
 		_num_counter_read ++;
 		_num_counter_write ++;
-		uint32_t idx = getChunkEntry(tag, &_chunks[chunk_num]);
-		ChunkEntry * chunk_entry = &_chunks[chunk_num].entries[idx];
+		uint32_t idx = getChunkEntry(tag, chunk);
+		ChunkEntry * chunk_entry = &chunk->entries[idx];
 		assert(idx < _mc->getNumWays()); 
 		chunk_entry->count ++;
-		//assert( idx == adjustEntryOrder(&_chunks[chunk_num], idx ));
+		//assert( idx == adjustEntryOrder(chunk, idx ));
 		if (chunk_entry->count >= _max_count_size) 
-			handleCounterOverflow(&_chunks[chunk_num], chunk_entry);
+			handleCounterOverflow(chunk, chunk_entry);
 	}
 }
 
@@ -253,16 +216,12 @@ PagePlacementPolicy::getChunkEntry(Address tag, ChunkInfo * chunk_info, bool all
 	}
 	if (idx == _num_entries_per_chunk && allocate) 
 	{
-	  	int64_t rand;
-		double f;
-	  	lrand48_r(&_buffer, &rand);
-		drand48_r(&_buffer, &f);
 		// randomly pick a victim entry
-		idx = _mc->getNumWays() + rand % (_num_entries_per_chunk - _mc->getNumWays());
+		idx = _mc->getNumWays() + _rng.nextBounded(_num_entries_per_chunk - _mc->getNumWays());
 		assert(idx >= _mc->getNumWays());
 		// replace the entry with certain probability.
 		// high count value reduces the probability
-		if (chunk_info->entries[idx].count > 0 && f > 1.0 / chunk_info->entries[idx].count)
+		if (chunk_info->entries[idx].count > 0 && _rng.nextDouble() > 1.0 / chunk_info->entries[idx].count)
 			idx = _num_entries_per_chunk;
 	}
 	if (idx < _num_entries_per_chunk) {
@@ -277,8 +236,7 @@ bool
 PagePlacementPolicy::sampleOrNot(double sample_rate, bool miss_rate_tune)
 {
 	double miss_rate = _mc->getRecentMissRate();
-	double f;
-	drand48_r(&_buffer, &f);
+	double f = _rng.nextDouble();
 	if (miss_rate_tune)
 		return f < sample_rate * miss_rate;
 	else 
@@ -372,57 +330,62 @@ PagePlacementPolicy::clearStats()
 void 
 PagePlacementPolicy::computeFreqDistr()
 {
-	assert(!_histogram);
-	//_histogram = new uint64_t [_num_entries_per_chunk];
+	if (!_histogram)
+		_histogram = gm_calloc<uint64_t>(_num_entries_per_chunk);
 	for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
 		_histogram[i] = 0;
 	for (uint64_t chunk_id = 0; chunk_id < _num_chunks; chunk_id ++)
 	{
-		// pick the most frequent chunk, then the second most frequent, etc. 
-		for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
-		{
-			uint32_t idx = _num_entries_per_chunk;
-			uint32_t max_count = 0; 
-			for (uint32_t j = 0; j < _num_entries_per_chunk; j++)
-			{
-				if (_chunks[chunk_id].entries[j].valid)
-				{
-					if (_chunks[chunk_id].entries[j].count > max_count)
-					{
-						max_count = _chunks[chunk_id].entries[j].count;
-						idx = j;
-					}
-				}
-				else 
-					break;
-			}
-			if (idx != _num_entries_per_chunk)
-			{
-				_histogram[i] += max_count;
-				_chunks[chunk_id].entries[idx].count = 0;
-			}
-			else 
-				break;
-		}
+		ChunkInfo * chunk = getChunk(chunk_id);
+		// sort the counters, so _histogram[i] accumulates the i-th most 
+		// frequent entry of each chunk. Works on a copy to leave the 
+		// counters untouched.
+		uint32_t counts[MAX_ENTRIES_PER_CHUNK];
+		uint32_t num_valid = 0;
+		for (uint32_t j = 0; j < _num_entries_per_chunk; j++)
+			if (chunk->entries[j].valid)
+				counts[num_valid++] = chunk->entries[j].count;
+		std::sort(counts, counts + num_valid, std::greater<uint32_t>());
+		for (uint32_t i = 0; i < num_valid; i++)
+			_histogram[i] += counts[i];
 	}
 }
 
 void 
-PagePlacementPolicy::updateLRU(uint64_t set_num, uint32_t way_num)
+PagePlacementPolicy::updateLRU(ChunkInfo * chunk, uint32_t way_num)
 {
 	for (uint32_t i = 0; i < _mc->getNumWays(); i++)
-		if (_lru_bits[set_num][i] < _lru_bits[set_num][way_num])
-			_lru_bits[set_num][i] ++;
-	_lru_bits[set_num][way_num] = 0;
+		if (chunk->lru_bits[i] < chunk->lru_bits[way_num])
+			chunk->lru_bits[i] ++;
+	chunk->lru_bits[way_num] = 0;
 }
 
 void 
 PagePlacementPolicy::flushChunk(uint32_t set)
 {
+	ChunkInfo * chunk = getChunk(set);
 	for (uint32_t i = 0; i < _num_entries_per_chunk; i ++) {
-		_chunks[set].entries[i].valid = false; 
-		_chunks[set].entries[i].tag = 0; 
-		_chunks[set].entries[i].count = 0; 
+		chunk->entries[i].valid = false; 
+		chunk->entries[i].tag = 0; 
+		chunk->entries[i].count = 0; 
 	}	
 }
 
+void 
+PagePlacementPolicy::validateChunk(Set * set, ChunkInfo * chunk)
+{
+	// the first few entries in chunk->entries must be in dram cache
+	for (uint32_t way = 0; way < _mc->getNumWays(); way++)
+		if (set->ways[way].valid) {
+			if (set->ways[way].tag != chunk->entries[way].tag)
+			{
+				for (uint32_t i = 0; i < _num_entries_per_chunk; i++)
+					printf("ID=%d, tag=%ld, valid=%d, count=%d\n", 
+						i, chunk->entries[i].tag, chunk->entries[i].valid, chunk->entries[i].count);
+				for (uint32_t i = 0; i < _mc->getNumWays(); i++)
+					printf("ID=%d, tag=%ld\n", i, set->ways[i].tag);
+			}
+			assert(set->ways[way].tag == chunk->entries[way].tag);
+		}
+}
+
@@ -2,6 +2,7 @@
 
 #include "config.h"
 #include "mc.h"
+#include "rng.h"
 
 class Way;
 class Set; 
@@ -17,7 +18,8 @@ public:
 	};
 
 	PagePlacementPolicy(MemoryController * mc) : _mc(mc) {};
-	void initialize(Config & config);
+	// Also lays out the ways of every set in _mc->getSets() (see _set_blocks)
+	void initialize(Config & config, uint64_t seed);
 	uint32_t handleCacheMiss(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access);
 	void handleCacheHit(Address tag, ReqType type, uint64_t set_num, Set * set, bool &counter_access, uint32_t hit_way);
 	
@@ -27,19 +29,23 @@ public:
 	RepScheme get_placement_policy() { return _placement_policy; }
 private:
 	MemoryController * _mc;
+	static const uint32_t MAX_ENTRIES_PER_CHUNK = 9;
 	struct ChunkEntry 
 	{
-		bool valid;
 		Address tag;
 		uint32_t count;
+		bool valid;
 	};
 	struct ChunkInfo 
 	{
-		uint32_t access_count;
-		ChunkEntry * entries;
 		uint64_t num_hits;
 		uint64_t num_misses;
+		uint8_t lru_bits[MAX_ENTRIES_PER_CHUNK - 1]; // LRU position of each way
+		ChunkEntry entries[MAX_ENTRIES_PER_CHUNK];
 	};
+	inline ChunkInfo * getChunk(uint64_t chunk_num) 
+		{ return (ChunkInfo *) (_set_blocks + chunk_num * _set_block_size + _chunk_offset); };
+	void validateChunk(Set * set, ChunkInfo * chunk);
 
 	uint32_t getChunkEntry(Address tag, ChunkInfo * chunk_info, bool allocate=true);
 	bool sampleOrNot(double sample_rate, bool miss_rate_tune = true);
@@ -48,23 +54,27 @@ private:
 	uint32_t pickVictimWay(ChunkInfo * chunk_info);
 	void handleCounterOverflow(ChunkInfo * chunk_info, ChunkEntry * overflow_entry);
 	void computeFreqDistr();
-	void updateLRU(uint64_t set_num, uint32_t way_num);
+	void updateLRU(ChunkInfo * chunk, uint32_t way_num);
 	double getCurrSampleRate();
 
 	RepScheme _placement_policy;
-	drand48_data _buffer;
+	BatchedRng<> _rng;
 	Scheme _scheme;	
-	uint32_t ** _lru_bits; // on per set
 
 	uint32_t _granularity;
-	// Frequency Base Replacement
-	ChunkInfo * _chunks;
+	// Per-set metadata. Each set owns one cache-line-aligned block that holds
+	// the set's ways followed by its ChunkInfo (FBR counters and LRU bits), so
+	// a miss or hit touches a single contiguous region.
+	char * _set_blocks;
+	uint64_t _set_block_size;
+	uint64_t _chunk_offset;
 	
 	// Parameters
 	uint64_t _num_chunks;
 	uint32_t _num_entries_per_chunk;
 	//uint32_t _num_stable_entries;
 	double _sample_rate;
+	uint64_t _sample_threshold;
 	uint32_t _access_count_threshold;
 	uint32_t _max_count_size;
 	bool _enable_replace;
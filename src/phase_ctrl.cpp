@@ -0,0 +1,121 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "phase_ctrl.h"
+#include "bithacks.h"
+#include "config.h"
+#include "contention_sim.h"
+#include "log.h"
+#include "mc.h"
+#include "zsim.h"
+
+PhaseLengthController::PhaseLengthController(Config& config, uint32_t initLength) {
+    minLength = config.get<uint32_t>("sim.adaptivePhase.minLength", MAX(initLength/8, (uint32_t)1));
+    maxLength = config.get<uint32_t>("sim.adaptivePhase.maxLength", initLength*4);
+    if (!minLength || minLength > initLength || maxLength < initLength) {
+        panic("sim.adaptivePhase needs 0 < minLength (%d) <= phaseLength (%d) <= maxLength (%d)", minLength, initLength, maxLength);
+    }
+    growPhases = config.get<uint32_t>("sim.adaptivePhase.growPhases", 4);
+    shrinkPhases = config.get<uint32_t>("sim.adaptivePhase.shrinkPhases", 1);
+    if (!growPhases || !shrinkPhases) panic("sim.adaptivePhase growPhases and shrinkPhases must be non-zero");
+
+    crossingsLow = config.get<double>("sim.adaptivePhase.crossingsLow", 1.0);
+    crossingsHigh = config.get<double>("sim.adaptivePhase.crossingsHigh", 10.0);
+    memReqsLow = config.get<double>("sim.adaptivePhase.memReqsLow", 1.0);
+    memReqsHigh = config.get<double>("sim.adaptivePhase.memReqsHigh", 10.0);
+    skewLow = config.get<double>("sim.adaptivePhase.skewLow", 1.0);
+    skewHigh = config.get<double>("sim.adaptivePhase.skewHigh", 20.0);
+    if (crossingsLow > crossingsHigh || memReqsLow > memReqsHigh || skewLow > skewHigh) {
+        panic("sim.adaptivePhase low thresholds must not exceed high thresholds");
+    }
+
+    calmPhases = 0;
+    busyPhases = 0;
+    lastMemReqs = 0;
+    curLength = initLength;
+    info("Adaptive phase length: %d cycles, in [%d, %d]", initLength, minLength, maxLength);
+}
+
+void PhaseLengthController::initStats(AggregateStat* parentStat) {
+    AggregateStat* phaseStat = new AggregateStat();
+    phaseStat->init("phase", "Adaptive phase length stats");
+    profLength.init("length", "Length of the current phase", &curLength);
+    phaseStat->append(&profLength);
+    profLengthHist.init("lengthHist", "Phases by log2(length)", 32);
+    phaseStat->append(&profLengthHist);
+    profGrows.init("grows", "Phase length increases");
+    phaseStat->append(&profGrows);
+    profShrinks.init("shrinks", "Phase length decreases");
+    phaseStat->append(&profShrinks);
+    profCrossings.init("crossings", "Crossing events completed");
+    phaseStat->append(&profCrossings);
+    profMemReqs.init("memReqs", "Memory controller requests");
+    phaseStat->append(&profMemReqs);
+    profSkew.init("skew", "Cycles of weave-phase delay added to the cores");
+    phaseStat->append(&profSkew);
+    parentStat->append(phaseStat);
+}
+
+void PhaseLengthController::nextPhase() {
+    //Rates over the phase that just ended, whose length is still in zinfo->phaseLength
+    uint32_t length = zinfo->phaseLength;
+    uint64_t crossings = zinfo->contentionSim->getPhaseCrossings();
+    uint64_t skew = zinfo->contentionSim->getPhaseSkew();
+    uint64_t memReqs = 0;
+    for (MemoryController* mc : memCtrls) memReqs += mc->getNumRequests();
+    uint64_t phaseMemReqs = memReqs - lastMemReqs;
+    lastMemReqs = memReqs;
+
+    profCrossings.inc(crossings);
+    profMemReqs.inc(phaseMemReqs);
+    profSkew.inc(skew);
+    profLengthHist.inc(ilog2(length));
+
+    double kcycles = length/1000.0;
+    double crossingRate = crossings/kcycles;
+    double memReqRate = phaseMemReqs/kcycles;
+    double skewRate = skew/(kcycles*zinfo->numCores);
+
+    bool busy = crossingRate > crossingsHigh || memReqRate > memReqsHigh || skewRate > skewHigh;
+    bool calm = crossingRate < crossingsLow && memReqRate < memReqsLow && skewRate < skewLow;
+    busyPhases = busy? busyPhases + 1 : 0;
+    calmPhases = calm? calmPhases + 1 : 0;
+
+    uint32_t next = zinfo->nextPhaseLength;
+    uint32_t after = next;
+    if (busyPhases >= shrinkPhases && next > minLength) {
+        after = MAX(minLength, next/2);
+        busyPhases = 0;
+        profShrinks.inc();
+    } else if (calmPhases >= growPhases && next < maxLength) {
+        after = MIN((uint64_t)maxLength, 2*(uint64_t)next);
+        calmPhases = 0;
+        profGrows.inc();
+    }
+
+    zinfo->phaseLength = next;
+    zinfo->nextPhaseLength = after;
+    curLength = next;
+}
@@ -0,0 +1,85 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHASE_CTRL_H_
+#define PHASE_CTRL_H_
+
+#include <stdint.h>
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+class Config;
+class MemoryController;
+
+/* Adapts the phase length to how much the bound and weave phases interact.
+ * At the end of each phase, it measures, per 1000 cycles of the phase:
+ *  - crossings: crossing events completed in the weave phase,
+ *  - memReqs: requests served by the DRAM cache memory controllers,
+ *  - skew: weave-phase delay added to the cores' clocks, per core.
+ * If any goes above its high threshold for shrinkPhases phases in a row, the
+ * phase length halves; if all stay below their low thresholds for growPhases
+ * phases in a row, it doubles. Lengths are clamped to [minLength, maxLength].
+ *
+ * Cores schedule their next barrier before the current phase ends, so the
+ * length is chosen one phase ahead: nextPhase() picks the length of the phase
+ * after zinfo->nextPhaseLength's.
+ */
+class PhaseLengthController : public GlobAlloc {
+    private:
+        uint32_t minLength, maxLength;
+        uint32_t growPhases, shrinkPhases;
+        double crossingsLow, crossingsHigh;
+        double memReqsLow, memReqsHigh;
+        double skewLow, skewHigh;
+
+        uint32_t calmPhases, busyPhases; //consecutive phases below all low / above some high threshold
+
+        g_vector<MemoryController*> memCtrls;
+        uint64_t lastMemReqs;
+
+        uint64_t curLength; //mirrors zinfo->phaseLength, for profLength
+
+        ProxyStat profLength;
+        VectorCounter profLengthHist;
+        Counter profGrows;
+        Counter profShrinks;
+        Counter profCrossings;
+        Counter profMemReqs;
+        Counter profSkew;
+
+    public:
+        PhaseLengthController(Config& config, uint32_t initLength);
+        void initStats(AggregateStat* parentStat);
+
+        uint32_t getMaxLength() const {return maxLength;}
+
+        void addMemController(MemoryController* mc) {memCtrls.push_back(mc);}
+
+        //Called at the barrier, once globPhaseCycles has moved past the phase that just ended
+        void nextPhase();
+};
+
+#endif  // PHASE_CTRL_H_
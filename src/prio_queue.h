@@ -26,8 +26,20 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
-#include "g_std/g_multimap.h"
+#include <stdint.h>
+#include "log.h"
 
+/* Bucket priority queue for timing events. Events in the next B 64-cycle
+ * blocks live in per-cycle LIFO lists, with an occupancy bitmap per block.
+ *
+ * Farther events go to a calendar of FB far buckets, each an intrusive list
+ * covering B/2 blocks. Every B/2 blocks, the bucket that enters the near
+ * window is drained into blocks[]. Events beyond the calendar's horizon (FB
+ * buckets past the window) sit in an overflow list that is redistributed
+ * each time the calendar wraps around. Far storage never allocates: it links
+ * events through their next pointer and needs their cycle, which it keeps in
+ * T::privCycle.
+ */
 template <typename T, uint32_t B>
 class PrioQueue {
     struct PQBlock {
@@ -60,18 +72,96 @@ class PrioQueue {
         }
     };
 
+    static const uint32_t FB = 64; // far buckets, one bit each in farOcc
+    static const uint64_t FAR_CYCLES = (B/2)*64; // cycles per far bucket
+
     PQBlock blocks[B];
 
-    typedef g_multimap<uint64_t, T*> FEMap; //far element map
-    typedef typename FEMap::iterator FEMapIterator;
+    T* farBuckets[FB]; // bucket k (cycles [k*FAR_CYCLES, (k+1)*FAR_CYCLES)) is in farBuckets[k % FB]
+    uint64_t farMin[FB]; // earliest cycle in each bucket
+    uint64_t farOcc; // bit i is 1 if farBuckets[i] is populated
 
-    FEMap feMap;
+    T* overflow; // beyond the calendar, unsorted
+    uint64_t overflowMin;
 
     uint64_t curBlock;
     uint64_t elems;
 
+    // Far elements are always in bucket curHalf()+2 or later
+    inline uint64_t curHalf() const {
+        return curBlock/(B/2);
+    }
+
+    inline void nearEnqueue(T* obj, uint64_t cycle) {
+        uint64_t absBlock = cycle/64;
+        assert(absBlock >= curBlock);
+        assert(absBlock < curBlock + B);
+        blocks[absBlock % B].enqueue(obj, cycle % 64);
+    }
+
+    inline void farEnqueue(T* obj, uint64_t cycle) {
+        uint64_t bucket = cycle/FAR_CYCLES;
+        assert(bucket >= curHalf() + 2);
+        obj->privCycle = cycle;
+        if (bucket < curHalf() + 2 + FB) {
+            uint32_t i = bucket % FB;
+            if (farOcc & (1L << i)) {
+                farMin[i] = MIN(farMin[i], cycle);
+            } else {
+                farOcc |= 1L << i;
+                farMin[i] = cycle;
+            }
+            obj->next = farBuckets[i];
+            farBuckets[i] = obj;
+        } else {
+            overflowMin = overflow? MIN(overflowMin, cycle) : cycle;
+            obj->next = overflow;
+            overflow = obj;
+        }
+    }
+
+    // Called when curBlock enters a new half; moves the bucket that now fits
+    // in the near window to blocks[]. Once per calendar wrap, also moves the
+    // overflow elements that now fit in the calendar. This goes after the
+    // drain, as the drained slot now holds the calendar's last bucket.
+    void migrate() {
+        uint64_t half = curHalf();
+        uint32_t i = (half + 1) % FB;
+        if (farOcc & (1L << i)) {
+            T* obj = farBuckets[i];
+            farBuckets[i] = nullptr;
+            farOcc ^= 1L << i;
+            while (obj) {
+                T* next = obj->next;
+                obj->next = nullptr;
+                assert(obj->privCycle/FAR_CYCLES == half + 1);
+                nearEnqueue(obj, obj->privCycle);
+                obj = next;
+            }
+        }
+
+        if ((half % FB) == 0 && overflow) {
+            T* obj = overflow;
+            overflow = nullptr;
+            while (obj) {
+                T* next = obj->next;
+                obj->next = nullptr;
+                farEnqueue(obj, obj->privCycle);
+                obj = next;
+            }
+        }
+    }
+
     public:
         PrioQueue() {
+            static_assert(B >= 2 && (B % 2) == 0, "PrioQueue needs an even number of blocks");
+            for (uint32_t i = 0; i < FB; i++) {
+                farBuckets[i] = nullptr;
+                farMin[i] = 0;
+            }
+            farOcc = 0;
+            overflow = nullptr;
+            overflowMin = 0;
             curBlock = 0;
             elems = 0;
         }
@@ -81,12 +171,9 @@ class PrioQueue {
             assert(absBlock >= curBlock);
 
             if (absBlock < curBlock + B) {
-                uint32_t i = absBlock % B;
-                uint32_t offset = cycle % 64;
-                blocks[i].enqueue(obj, offset);
+                nearEnqueue(obj, cycle);
             } else {
-                //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                farEnqueue(obj, cycle);
             }
             elems++;
         }
@@ -95,24 +182,7 @@ class PrioQueue {
             assert(elems);
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % (B/2)) == 0 && (farOcc || overflow)) migrate();
             }
 
             //We're now at the first populated block
@@ -137,18 +207,27 @@ class PrioQueue {
                     return (curBlock + i)*64 + pos;
                 }
             }
-            for (uint32_t i = B/2; i < B; i++) { //beyond B/2 blocks, there may be a far element that comes earlier
+            //Beyond B/2 blocks, an element in the first far bucket may come earlier
+            uint32_t first = (curHalf() + 2) % FB;
+            for (uint32_t i = B/2; i < B; i++) {
                 uint64_t occ = blocks[(curBlock + i) % B].occ;
                 if (occ) {
                     uint64_t pos = __builtin_ctzl(occ);
                     uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                    return (farOcc & (1L << first))? MIN(cycle, farMin[first]) : cycle;
                 }
             }
 
-            return feMap.begin()->first;
+            if (farOcc) {
+                //Rotate so that bit 0 is the first far bucket
+                uint64_t rot = first? ((farOcc >> first) | (farOcc << (FB - first))) : farOcc;
+                uint64_t cycle = farMin[(first + __builtin_ctzl(rot)) % FB];
+                //Overflow elements enqueued before the last calendar wrap may precede later buckets
+                return overflow? MIN(cycle, overflowMin) : cycle;
+            }
+            assert(overflow);
+            return overflowMin;
         }
 };
 
 #endif  // PRIO_QUEUE_H_
-
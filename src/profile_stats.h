@@ -96,6 +96,7 @@ class TimeBreakdownStat : public VectorCounter {
         void transition(uint32_t newState) {
             assert(curState < size());
             assert(newState < size());
+            if (newState == curState) return; //same totals, and saves reading the clock on hot loops
 
             uint64_t curNs = getNs();
             assert(curNs >= startNs);
@@ -0,0 +1,138 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RNG_H_
+#define RNG_H_
+
+/* Small, fast, deterministic random number generators for simulator
+ * components (samplers in the DRAM cache policies, the filter cache TLB...).
+ *
+ * All seeds derive from a single root seed (sim.seed, stored in
+ * zinfo->seed) plus a per-component name, so runs are bit-reproducible
+ * across machines and launches, and adding a component does not perturb the
+ * streams of others. Rng is xoshiro256** (Blackman & Vigna); BatchedRng
+ * amortizes generation over blocks of numbers for hot samplers.
+ */
+
+#include <stdint.h>
+#include "log.h"
+
+// splitmix64 step, used to expand seeds
+static inline uint64_t SplitMix64(uint64_t& x) {
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Seed for a component, from the root seed, its name, and an optional index
+static inline uint64_t DeriveSeed(uint64_t rootSeed, const char* component, uint64_t idx = 0) {
+    uint64_t h = 0xCBF29CE484222325ull;  // FNV-1a
+    for (const char* c = component; *c; c++) h = (h ^ (uint8_t)*c) * 0x100000001B3ull;
+    uint64_t x = rootSeed ^ h;
+    SplitMix64(x);
+    x ^= idx;
+    return SplitMix64(x);
+}
+
+class Rng {
+    private:
+        uint64_t s[4];
+
+        static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    public:
+        explicit Rng(uint64_t seed = 0) { init(seed); }
+
+        void init(uint64_t seed) {
+            uint64_t x = seed;
+            for (uint32_t i = 0; i < 4; i++) s[i] = SplitMix64(x);
+        }
+
+        inline uint64_t next() {
+            uint64_t res = rotl(s[1] * 5, 7) * 9;
+            uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return res;
+        }
+
+        void fill(uint64_t* buf, uint32_t n) {
+            for (uint32_t i = 0; i < n; i++) buf[i] = next();
+        }
+
+        // Conversions from a raw 64-bit draw; shared with BatchedRng
+        // Uniform double in [0, 1)
+        static inline double toDouble(uint64_t r) { return (r >> 11) * (1.0 / (1ull << 53)); }
+        // Uniform integer in [0, n) (multiply-shift, no division)
+        static inline uint64_t toBounded(uint64_t r, uint64_t n) { return (uint64_t)(((__uint128_t)r * n) >> 64); }
+        // Bernoulli trials: precompute sampleThreshold(p) once, then
+        // toSample(r, threshold) is true with probability p, without floating point
+        static inline uint64_t sampleThreshold(double p) {
+            if (p <= 0.0) return 0;
+            if (p >= 1.0) return 1ull << 53;
+            return (uint64_t)(p * (1ull << 53));
+        }
+        static inline bool toSample(uint64_t r, uint64_t threshold) { return (r >> 11) < threshold; }
+
+        inline double nextDouble() { return toDouble(next()); }
+        inline uint64_t nextBounded(uint64_t n) { return toBounded(next(), n); }
+        inline bool sample(uint64_t threshold) { return toSample(next(), threshold); }
+};
+
+// Generates numbers in blocks of B. Same sequence as Rng with the same seed.
+template <uint32_t B = 64>
+class BatchedRng {
+    private:
+        Rng rng;
+        uint64_t buf[B];
+        uint32_t pos;
+
+    public:
+        explicit BatchedRng(uint64_t seed = 0) { init(seed); }
+
+        void init(uint64_t seed) {
+            rng.init(seed);
+            pos = B;
+        }
+
+        inline uint64_t next() {
+            if (unlikely(pos == B)) {
+                rng.fill(buf, B);
+                pos = 0;
+            }
+            return buf[pos++];
+        }
+
+        inline double nextDouble() { return Rng::toDouble(next()); }
+        inline uint64_t nextBounded(uint64_t n) { return Rng::toBounded(next(), n); }
+        inline bool sample(uint64_t threshold) { return Rng::toSample(next(), threshold); }
+};
+
+#endif  // RNG_H_
@@ -39,6 +39,7 @@
 #include "g_std/g_unordered_set.h"
 #include "g_std/g_vector.h"
 #include "intrusive_list.h"
+#include "phase_ctrl.h"
 #include "proc_stats.h"
 #include "process_stats.h"
 #include "stats.h"
@@ -102,7 +103,7 @@ class Scheduler : public GlobAlloc, public Callee {
             volatile bool needsJoin; //after waiting on the scheduler, should we join the barrier, or is our cid good to go already?
 
             bool markedForSleep; //if true, we will go to sleep on the next leave()
-            uint64_t wakeupPhase; //if SLEEPING, when do we have to wake up?
+            uint64_t wakeupCycle; //if SLEEPING, when do we have to wake up? Absolute cycle, since phases need not have the same length
 
             g_vector<bool> mask;
 
@@ -118,7 +119,7 @@ class Scheduler : public GlobAlloc, public Callee {
                 handoffThread = nullptr;
                 futexWord = 0;
                 markedForSleep = false;
-                wakeupPhase = 0;
+                wakeupCycle = 0;
                 assert(mask.size() == zinfo->numCores);
                 uint32_t count = 0;
                 for (auto b : mask) if (b) count++;
@@ -168,8 +169,8 @@ class Scheduler : public GlobAlloc, public Callee {
         inline uint32_t getTid(uint32_t gid) const {return gid & 0x0FFFF;}
 
     public:
-        Scheduler(void (*_atSyncFunc)(void), uint32_t _parallelThreads, uint32_t _numCores, uint32_t _schedQuantum) :
-            atSyncFunc(_atSyncFunc), bar(_parallelThreads, this), numCores(_numCores), schedQuantum(_schedQuantum), rnd(0x5C73D9134)
+        Scheduler(void (*_atSyncFunc)(void), uint32_t _parallelThreads, uint32_t _numCores, uint32_t _schedQuantum, uint32_t _barrierFanout = 0) :
+            atSyncFunc(_atSyncFunc), bar(_parallelThreads, this, _barrierFanout), numCores(_numCores), schedQuantum(_schedQuantum), rnd(0x5C73D9134)
         {
             contexts.resize(numCores);
             for (uint32_t i = 0; i < numCores; i++) {
@@ -337,20 +338,20 @@ class Scheduler : public GlobAlloc, public Callee {
             zinfo->cores[cid]->leave();
 
             if (th->markedForSleep) { //transition to SLEEPING, eagerly deschedule
-                trace(Sched, "Sched: %d going to SLEEP, wakeup on phase %ld", gid, th->wakeupPhase);
+                trace(Sched, "Sched: %d going to SLEEP, wakeup on cycle %ld", gid, th->wakeupCycle);
                 th->markedForSleep = false;
                 ContextInfo* ctx = &contexts[cid];
                 deschedule(th, ctx, SLEEPING);
 
                 //Ordered insert into sleepQueue
-                if (sleepQueue.empty() || sleepQueue.front()->wakeupPhase > th->wakeupPhase) {
+                if (sleepQueue.empty() || sleepQueue.front()->wakeupCycle > th->wakeupCycle) {
                     sleepQueue.push_front(th);
                 } else {
                     ThreadInfo* cur = sleepQueue.front();
-                    while (cur->next && cur->next->wakeupPhase <= th->wakeupPhase) {
+                    while (cur->next && cur->next->wakeupCycle <= th->wakeupCycle) {
                         cur = cur->next;
                     }
-                    trace(Sched, "Put %d in sleepQueue (deadline %ld), after %d (deadline %ld)", gid, th->wakeupPhase, cur->gid, cur->wakeupPhase);
+                    trace(Sched, "Put %d in sleepQueue (deadline %ld), after %d (deadline %ld)", gid, th->wakeupCycle, cur->gid, cur->wakeupCycle);
                     sleepQueue.insertAfter(cur, th);
                 }
                 sleepEvents.inc();
@@ -432,6 +433,7 @@ class Scheduler : public GlobAlloc, public Callee {
             /* End of phase accounting */
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            if (zinfo->phaseCtrl) zinfo->phaseCtrl->nextPhase();
             curPhase++;
 
             assert(curPhase == zinfo->numPhases); //check they don't skew
@@ -439,9 +441,8 @@ class Scheduler : public GlobAlloc, public Callee {
             //Wake up all sleeping threads where deadline is met
             if (!sleepQueue.empty()) {
                 ThreadInfo* th = sleepQueue.front();
-                while (th && th->wakeupPhase <= curPhase) {
-                    assert(th->wakeupPhase == curPhase);
-                    trace(Sched, "%d SLEEPING -> BLOCKED, waking up from timeout syscall (curPhase %ld, wakeupPhase %ld)", th->gid, curPhase, th->wakeupPhase);
+                while (th && th->wakeupCycle <= zinfo->globPhaseCycles) {
+                    trace(Sched, "%d SLEEPING -> BLOCKED, waking up from timeout syscall (curCycle %ld, wakeupCycle %ld)", th->gid, zinfo->globPhaseCycles, th->wakeupCycle);
 
                     // Try to deschedule ourselves
                     th->state = BLOCKED;
@@ -460,14 +461,14 @@ class Scheduler : public GlobAlloc, public Callee {
             }
         }
 
-        volatile uint32_t* markForSleep(uint32_t pid, uint32_t tid, uint64_t wakeupPhase) {
+        volatile uint32_t* markForSleep(uint32_t pid, uint32_t tid, uint64_t wakeupCycle) {
             futex_lock(&schedLock);
             uint32_t gid = getGid(pid, tid);
             trace(Sched, "%d marking for sleep", gid);
             ThreadInfo* th = gidMap[gid];
             assert(!th->markedForSleep);
             th->markedForSleep = true;
-            th->wakeupPhase = wakeupPhase;
+            th->wakeupCycle = wakeupCycle;
             th->futexWord = 1; //to avoid races, this must be set here.
             futex_unlock(&schedLock);
             return &(th->futexWord);
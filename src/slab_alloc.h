@@ -33,6 +33,13 @@
  * are garbage-collected once all their events are done. To do this without space
  * overheads, slabs are carefully aligned, so that objects inside the slab can
  * derive the pointer of their slab.
+ *
+ * Slabs are freed by whichever contention thread retires their last event, so
+ * each allocator keeps two free lists: a private one, used only by its owner,
+ * and a lock-free list that freeing threads push slabs to. When the
+ * private list runs out, the owner takes the whole remote list in one atomic
+ * swap. Allocations happen in the bound phase and frees in the weave phase,
+ * so curSlab never changes under a free.
  */
 
 #include <deque>
@@ -40,7 +47,8 @@
 #include <stdint.h>
 #include "g_std/g_vector.h"
 #include "log.h"
-#include "mutex.h"
+#include "pad.h"
+#include "stats.h"
 
 #define SLAB_SIZE (1<<16)  // 64KB; must be a power of two
 #define SLAB_MASK (~(SLAB_SIZE - 1))
@@ -55,12 +63,14 @@ class SlabAlloc;
 
 struct Slab {  // POD type (no constructor)
     SlabAlloc* allocator;
+    Slab* next;  // in the allocator's remote free list
     volatile uint32_t liveElems;
     uint32_t usedBytes;
-    char buf[SLAB_SIZE - sizeof(SlabAlloc*) - sizeof(volatile uint32_t) - sizeof(uint32_t)];
+    char buf[SLAB_SIZE - sizeof(SlabAlloc*) - sizeof(Slab*) - sizeof(volatile uint32_t) - sizeof(uint32_t)];
 
     void init(SlabAlloc* _allocator) {
         allocator = _allocator;
+        next = nullptr;
         clear();
     }
 
@@ -93,13 +103,24 @@ struct Slab {  // POD type (no constructor)
 
 class SlabAlloc {
     private:
+        // Owner-only
         Slab* curSlab;
         g_vector<Slab*> freeList;
-        uint32_t liveSlabs;
-        mutex freeLock;  // used because slab frees may be concurrent
+        uint64_t slabs;  // allocated from the global heap
+        uint64_t slabReuses;  // taken from the free lists
+        uint64_t remoteBatches;  // remote free lists taken
+
+        PAD();
+
+        // Written by any thread. Slabs are only pushed here, and the owner
+        // takes the whole list at once, so there is no ABA problem.
+        Slab* volatile remoteFree;
+        uint64_t slabFrees;
+
+        PAD();
 
     public:
-        SlabAlloc() : curSlab(nullptr), liveSlabs(0) {
+        SlabAlloc() : curSlab(nullptr), slabs(0), slabReuses(0), remoteBatches(0), remoteFree(nullptr), slabFrees(0) {
             allocSlab();
         }
 
@@ -117,35 +138,70 @@ class SlabAlloc {
 
         template <typename T> T* alloc() { return (T*)alloc(sizeof(T)); }
 
+        uint64_t getLiveSlabs() const { return slabs + slabReuses - slabFrees; }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* slabStat = new AggregateStat();
+            slabStat->init("slabs", "Event slab allocator stats");
+            ProxyStat* slabsStat = new ProxyStat();
+            slabsStat->init("allocs", "Slabs allocated from the global heap", &slabs);
+            slabStat->append(slabsStat);
+            ProxyStat* reusesStat = new ProxyStat();
+            reusesStat->init("reuses", "Slabs reused from the free lists", &slabReuses);
+            slabStat->append(reusesStat);
+            ProxyStat* freesStat = new ProxyStat();
+            freesStat->init("frees", "Slabs freed", &slabFrees);
+            slabStat->append(freesStat);
+            ProxyStat* batchesStat = new ProxyStat();
+            batchesStat->init("batches", "Batches of freed slabs returned to the owner", &remoteBatches);
+            slabStat->append(batchesStat);
+            auto live = [this]() { return getLiveSlabs(); };
+            LambdaStat<decltype(live)>* liveStat = new LambdaStat<decltype(live)>(live);
+            liveStat->init("live", "Slabs in use");
+            slabStat->append(liveStat);
+            parentStat->append(slabStat);
+        }
+
     private:
         void allocSlab() {
-            scoped_mutex sm(freeLock);
+            if (freeList.empty() && remoteFree) {
+                Slab* s = __sync_lock_test_and_set(&remoteFree, nullptr);
+                remoteBatches++;
+                while (s) {
+                    freeList.push_back(s);
+                    s = s->next;
+                }
+            }
+
             if (!freeList.empty()) {
                 curSlab = freeList.back();
                 freeList.pop_back();
                 assert(curSlab);
+                slabReuses++;
             } else {
                 assert(sizeof(Slab) == SLAB_SIZE);
                 curSlab = gm_memalign<Slab>(sizeof(Slab));
                 assert((((uintptr_t)curSlab) & SLAB_MASK) == (uintptr_t)curSlab);
                 curSlab->init(this);  // NOTE: Slab is POD
+                slabs++;
             }
-            liveSlabs++;
-            //info("allocated slab %p, %d live, %ld in freeList", curSlab, liveSlabs, freeList.size());
+            //info("allocated slab %p, %ld live, %ld in freeList", curSlab, getLiveSlabs(), freeList.size());
         }
 
         void freeSlab(Slab* s) {
-            scoped_mutex sm(freeLock);
-            //info("freeing slab %p, %d live, %ld in freeList", s, liveSlabs, freeList.size());
+            //info("freeing slab %p, %ld live", s, getLiveSlabs());
             s->clear();
 #ifdef DEBUG_SLAB_ALLOC
             memset(s->buf, -1, sizeof(s->buf));
 #endif
             if (s != curSlab) {
-                freeList.push_back(s);
-                liveSlabs--;
+                Slab* head;
+                do {
+                    head = remoteFree;
+                    s->next = head;
+                } while (!__sync_bool_compare_and_swap(&remoteFree, head, s));
+                __sync_fetch_and_add(&slabFrees, 1);
             }
-            assert(liveSlabs);  // at least curSlab
         }
 
         friend struct Slab;
@@ -62,8 +62,8 @@ class TimingCore : public Core {
 
         //Contention simulation interface
         inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
-        void cSimStart() {curCycle = cRec.cSimStart(curCycle);}
-        void cSimEnd() {curCycle = cRec.cSimEnd(curCycle);}
+        virtual void cSimStart() {curCycle = cRec.cSimStart(curCycle);}
+        virtual void cSimEnd() {curCycle = cRec.cSimEnd(curCycle);}
 
     private:
         inline void loadAndRecord(Address addr);
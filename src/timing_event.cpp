@@ -163,6 +163,7 @@ void CrossingEvent::simulate(uint64_t simCycle) {
     //Runs if called
     //assert_msg(simCycle <= doneCycle+preSlack+postSlack+1, "simCycle %ld doneCycle %ld, preSlack %d postSlack %d simCount %ld child %s", simCycle, doneCycle, preSlack, postSlack, simCount, typeid(*child).name());
     zinfo->contentionSim->setPrio(domain, 0);
+    zinfo->contentionSim->countCrossing(domain);
 
 #if PROFILE_CROSSINGS
     zinfo->contentionSim->profileCrossing(srcDomain, domain, simCount);
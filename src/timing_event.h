@@ -66,7 +66,7 @@ class CrossingEvent;
 
 class TimingEvent {
     private:
-        uint64_t privCycle; //only touched by ContentionSim
+        uint64_t privCycle; //only touched by ContentionSim and its PrioQueue
 
     public:
         TimingEvent* next; //used by PrioQueue --- PRIVATE
@@ -283,6 +283,7 @@ class TimingEvent {
     friend class ContentionSim;
     friend class DelayEvent; //DelayEvent is, for now, the only child of TimingEvent that should do anything other than implement simulate
     friend class CrossingEvent;
+    template <typename T, uint32_t B> friend class PrioQueue;
 };
 
 class DelayEvent : public TimingEvent {
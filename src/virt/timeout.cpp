@@ -117,11 +117,10 @@ static bool PrePatchTimeoutSyscall(uint32_t tid, CONTEXT* ctxt, SYSCALL_STANDARD
     //info("[%d] pre-patch %s (%d) waitNsec = %ld", tid, GetSyscallName(syscall), syscall, waitNsec);
 
     uint64_t waitCycles = waitNsec*zinfo->freqMHz/1000;
-    uint64_t waitPhases = waitCycles/zinfo->phaseLength;
-    if (waitPhases < 2) waitPhases = 2;  // at least wait 2 phases; this should basically eliminate the chance that we get a SIGSYS before we start executing the syscal instruction
-    uint64_t wakeupPhase = zinfo->numPhases + waitPhases;
+    if (waitCycles <= zinfo->phaseLength) waitCycles = zinfo->phaseLength + 1;  // at least wait 2 phases; this should basically eliminate the chance that we get a SIGSYS before we start executing the syscal instruction
+    uint64_t wakeupCycle = zinfo->globPhaseCycles + waitCycles;
 
-    /*volatile uint32_t* futexWord =*/ zinfo->sched->markForSleep(procIdx, tid, wakeupPhase);  // we still want to mark for sleep, bear with me...
+    /*volatile uint32_t* futexWord =*/ zinfo->sched->markForSleep(procIdx, tid, wakeupCycle);  // we still want to mark for sleep, bear with me...
     inFakeTimeoutMode[tid] = true;
     return true;
 }
@@ -49,8 +49,10 @@
 #include "debug_zsim.h"
 #include "event_queue.h"
 #include "galloc.h"
+#include "host_placement.h"
 #include "init.h"
 #include "log.h"
+#include "phase_ctrl.h"
 #include "pin.H"
 #include "pin_cmd.h"
 #include "process_tree.h"
@@ -299,7 +301,7 @@ VOID FFITrackNFFInterval() {
         *_ffiPrevFFStartInstrs = *_ffiFFStartInstrs;
         *_ffiFFStartInstrs = zinfo->processStats->getProcessInstrs(p);
     };
-    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->phaseLength));
+    zinfo->eventQueue->insert(makeAdaptiveEvent(ffiGet, ffiFire, 0, ffiInstrsLimit - ffiInstrsDone, MAX_IPC*zinfo->maxPhaseLength));
 
     ffiNFF = true;
 }
@@ -830,20 +832,8 @@ void SimThreadStart(THREADID tid) {
     zinfo->sched->start(procIdx, tid, procTreeNode->getMask());
     activeThreads[tid] = true;
 
-    //Pinning
-#if 0
-    if (true) {
-        uint32_t nprocs = sysconf(_SC_NPROCESSORS_ONLN);
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(tid % nprocs, &cpuset);
-        //HMM, can we do this? I doubt it
-        //int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
-        //Since we're running multiprocess, this suffices for now:
-        int result = sched_setaffinity(getpid(), sizeof(cpu_set_t), &cpuset);
-        assert(result == 0);
-    }
-#endif
+    //Pinning (sim.hostPlacement.appCpus)
+    zinfo->hostPlacement->pinAppThread();
 
     //Initialize this thread's process-local data
     fPtrs[tid] = joinPtrs; //delayed, MT-safe barrier join
@@ -1569,6 +1559,7 @@ int main(int argc, char *argv[]) {
             EndOfPhaseActions();
             zinfo->numPhases++;
             zinfo->globPhaseCycles += zinfo->phaseLength;
+            if (zinfo->phaseCtrl) zinfo->phaseCtrl->nextPhase();
         }
         info("Finished trace-driven simulation");
         SimEnd();
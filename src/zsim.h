@@ -48,6 +48,8 @@ class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class PhaseLengthController;
+class HostPlacement;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -88,17 +90,22 @@ struct GlobSimInfo {
     //Contention simulation
     uint32_t numDomains;
     ContentionSim* contentionSim;
+    HostPlacement* hostPlacement; //host CPU and NUMA placement of zsim threads and state
     EventRecorder** eventRecorders; //CID->EventRecorder* array
 
     PAD();
 
     //World-readable
-    uint32_t phaseLength;
+    uint32_t phaseLength; //of the current phase
+    uint32_t nextPhaseLength; //cores set their next barrier before the current phase ends, so this is chosen a phase ahead
+    uint32_t maxPhaseLength;
+    PhaseLengthController* phaseCtrl; //nullptr unless sim.adaptivePhase.enable
+    uint64_t seed; //root seed of all simulator RNGs, see rng.h
     uint32_t statsPhaseInterval;
     uint32_t freqMHz;
 
     //Maxima/termination conditions
-    uint64_t maxPhases; //terminate when this many phases have been reached
+    uint64_t maxPhases; //terminate when this many phases have been reached (phases vary in length with sim.adaptivePhase, so this does not bound cycles)
     uint64_t maxMinInstrs; //terminate when all threads have reached this many instructions
     uint64_t maxTotalInstrs; //terminate when the aggregate number of instructions reaches this number
     uint64_t maxSimTimeNs; //terminate when the simulation time (bound+weave) exceeds this many ns
@@ -113,7 +120,7 @@ struct GlobSimInfo {
 
     //Writable, rarely read, unshared in a single phase
     uint64_t numPhases;
-    uint64_t globPhaseCycles; //just numPhases*phaseCycles. It behooves us to precompute it, since it is very frequently used in tracing code.
+    uint64_t globPhaseCycles; //cycle at which the current phase starts; the sum of all past phase lengths, which may differ with adaptive phase lengths
 
     uint64_t procEventualDumps;
 
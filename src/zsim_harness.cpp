@@ -27,14 +27,18 @@
  * slave pin processes, coordinating and terminating runs, and stats printing.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <fstream>
 #include <iostream>
+#include <linux/perf_event.h>
 #include <signal.h>
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <sys/personality.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
@@ -201,8 +205,37 @@ static time_t startTime;
 static time_t lastHeartbeatTime;
 static uint64_t lastCycles = 0;
 
+/* Counts the user-level dTLB load misses of the harness and all its
+ * descendants (the pin processes and their threads), which inherit the counter
+ * as they are created. Sampled into the global heap's counters on every
+ * heartbeat, and printed at the end. Returns -1 if perf events are unavailable.
+ */
+static int openTlbMissCounter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = syscall(SYS_perf_event_open, &attr, 0 /*this process*/, -1 /*any cpu*/, -1 /*no group*/, 0);
+    if (fd == -1) {
+        warn("Could not open the host dTLB miss counter (%s), not counting TLB misses", strerror(errno));
+    } else {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static uint64_t readTlbMissCounter(int fd) {
+    uint64_t misses = 0;
+    if (fd != -1 && read(fd, &misses, sizeof(misses)) != sizeof(misses)) misses = 0;
+    return misses;
+}
+
 static void printHeartbeat(GlobSimInfo* zinfo) {
-    uint64_t cycles = zinfo->numPhases*zinfo->phaseLength;
+    uint64_t cycles = zinfo->globPhaseCycles;
     time_t curTime = time(nullptr);
     time_t elapsedSecs = curTime - startTime;
     time_t heartbeatSecs = curTime - lastHeartbeatTime;
@@ -357,9 +390,23 @@ int main(int argc, char *argv[]) {
     if (removedLogfiles) info("Removed %d old logfiles", removedLogfiles);
 
     uint32_t gmSize = conf.get<uint32_t>("sim.gmMBytes", (1<<10) /*default 1024MB*/);
-    info("Creating global segment, %d MBs", gmSize);
-    int shmid = gm_init(((size_t)gmSize) << 20 /*MB to Bytes*/);
+    uint32_t gmArenas = conf.get<uint32_t>("sim.gmArenas", sysconf(_SC_NPROCESSORS_ONLN)); //0 serializes all allocations on one lock
+    bool gmHugePages = conf.get<bool>("sim.gmHugePages", false);
+    info("Creating global segment, %d MBs, %d arenas%s", gmSize, gmArenas, gmHugePages? ", huge pages" : "");
+    int shmid = gm_init(((size_t)gmSize) << 20 /*MB to Bytes*/, gmArenas, gmHugePages);
     info("Global segment shmid = %d", shmid);
+    if (gmHugePages) {
+        gm_counters gmc;
+        gm_get_counters(&gmc);
+        if (gmc.hugePages == GM_HUGE_NONE) {
+            warn("Huge pages unavailable, using regular pages for the global segment");
+        } else {
+            info("Global segment uses %s", (gmc.hugePages == GM_HUGE_HUGETLB)? "hugetlbfs pages" : "transparent huge pages (if the kernel allows them for shared memory)");
+        }
+    }
+
+    //Must be opened before launching children, so that they inherit it
+    int tlbMissFd = conf.get<bool>("sim.countTlbMisses", true)? openTlbMissCounter() : -1;
     //fprintf(stderr, "%sGlobal segment shmid = %d\n", logHeader, shmid); //hack to print shmid on both streams
     //fflush(stderr);
 
@@ -449,6 +496,7 @@ int main(int argc, char *argv[]) {
         }
 
         printHeartbeat(zinfo);
+        if (tlbMissFd != -1) gm_set_host_tlb_misses(readTlbMissCounter(tlbMissFd));
 
         //This solves a weird race in multiprocess where SIGCHLD does not always fire...
         int cpid = -1;
@@ -472,6 +520,8 @@ int main(int argc, char *argv[]) {
         exitCode = 1;
     }
     if (zinfo && zinfo->globalActiveProcs) warn("Unclean exit of %d children, termination stats were most likely not dumped", zinfo->globalActiveProcs);
+    //Exited children's counts have been folded into ours by now
+    if (tlbMissFd != -1) info("Host dTLB load misses: %ld", readTlbMissCounter(tlbMissFd));
     exit(exitCode);
 }
 